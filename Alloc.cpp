@@ -0,0 +1,138 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Alloc.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace suflem;
+
+static thread_local long allocations = 0;
+
+#ifdef SUFLEM_ALLOC_STATS
+static thread_local alloc::Phase current_phase = alloc::OTHER;
+static std::atomic<long> phase_counts[alloc::NUM_PHASES];
+static std::atomic<long> phase_bytes[alloc::NUM_PHASES];
+#endif
+
+static char const* const PHASE_NAMES[alloc::NUM_PHASES] = {
+    "other", "load", "train", "trim", "lemmatize"
+};
+
+namespace suflem {
+namespace alloc {
+
+long count() {
+    return allocations;
+}
+
+#ifdef SUFLEM_ALLOC_STATS
+bool accounting() {
+    return true;
+}
+
+Phase set_phase(Phase phase) {
+    Phase previous = current_phase;
+    current_phase = phase;
+    return previous;
+}
+
+Usage usage(Phase phase) {
+    Usage u;
+    u.count = phase_counts[phase].load(std::memory_order_relaxed);
+    u.bytes = phase_bytes[phase].load(std::memory_order_relaxed);
+    return u;
+}
+#else
+bool accounting() {
+    return false;
+}
+
+Phase set_phase(Phase) {
+    return OTHER;
+}
+
+Usage usage(Phase) {
+    return Usage();
+}
+#endif
+
+char const* name(Phase phase) {
+    return PHASE_NAMES[phase];
+}
+
+} // namespace alloc
+} // namespace suflem
+
+///////////////////////////////////////////////////////////////////////////////
+// Replacements of the global allocation functions
+///////////////////////////////////////////////////////////////////////////////
+
+static inline void account(std::size_t size) {
+    ++allocations;
+#ifdef SUFLEM_ALLOC_STATS
+    phase_counts[current_phase].fetch_add(1, std::memory_order_relaxed);
+    phase_bytes[current_phase].fetch_add(size, std::memory_order_relaxed);
+#else
+    (void) size;
+#endif
+}
+
+static inline void* allocate(std::size_t size) {
+    account(size);
+    void* p = malloc(size > 0 ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new(std::size_t size) {
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+    return allocate(size);
+}
+
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept {
+    account(size);
+    return malloc(size > 0 ? size : 1);
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept {
+    account(size);
+    return malloc(size > 0 ? size : 1);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    free(p);
+}
@@ -0,0 +1,85 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef ALLOC_HPP_INCLUDED
+#define ALLOC_HPP_INCLUDED
+
+namespace suflem {
+
+/// Counting of heap allocations.
+/// The suflem program replaces the global operator new, counting the
+/// allocations of every thread in a thread local counter, which costs no
+/// synchronization. Programs using only the library do not count.
+///
+/// When built with SUFLEM_ALLOC_STATS defined (`scons allocstats=1`), the
+/// allocations and their bytes are also accounted to the phase the
+/// allocating thread is in. The accounts are shared by all threads, which
+/// makes every allocation a few atomic operations more expensive.
+namespace alloc {
+
+/// Number of allocations made by the calling thread so far.
+long count();
+
+/// Phases of the work allocations are accounted to.
+enum Phase {
+    OTHER,      ///< anything outside the other phases
+    LOAD,       ///< loading a model
+    TRAIN,      ///< training or updating a model
+    TRIM,       ///< trimming a model
+    LEMMATIZE,  ///< lemmatizing words
+    NUM_PHASES
+};
+
+/// Allocations accounted to a phase.
+struct Usage {
+    long count;  ///< number of allocations
+    long bytes;  ///< bytes requested by the allocations
+
+    Usage() : count(0), bytes(0) {}
+};
+
+/// Is the accounting by phase compiled in.
+bool accounting();
+
+/// Set the phase of the calling thread.
+/// \return The previous phase of the thread.
+Phase set_phase(Phase phase);
+
+/// Allocations of all threads in a phase so far.
+/// Zero, if the accounting is not compiled in.
+Usage usage(Phase phase);
+
+/// Name of a phase, as used in the reports.
+char const* name(Phase phase);
+
+/// Accounts the allocations of the calling thread to a phase while alive.
+class PhaseScope {
+#ifdef SUFLEM_ALLOC_STATS
+    Phase _previous;
+
+public:
+    explicit PhaseScope(Phase phase) : _previous(set_phase(phase)) {}
+    ~PhaseScope() { set_phase(_previous); }
+#else
+public:
+    explicit PhaseScope(Phase) {}
+#endif
+};
+
+} // namespace alloc
+} // namespace suflem
+
+#endif // ALLOC_HPP_INCLUDED
@@ -0,0 +1,345 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Cache.hpp"
+
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace suflem {
+
+///////////////////////////////////////////////////////////////////////////////
+// Cache file layout
+///////////////////////////////////////////////////////////////////////////////
+
+// The file consists of a header, a power of two sized slot array and a heap.
+// Each slot holds the hash of a word and the heap offset of its entry,
+// zero offset denotes an empty slot. Heap entries consist of the inflected
+// word length, the lemma length, followed by the bytes of both strings.
+
+static char const CACHE_MAGIC[8] = {'S', 'U', 'F', 'L', 'E', 'M', 'C', '1'};
+static uint64_t const INITIAL_SLOTS = 1 << 12;
+static uint64_t const INITIAL_HEAP  = 1 << 16;
+static uint64_t const HEAP_START    = 8;
+
+struct CacheHeader {
+    char magic[8];
+    uint64_t model_hash;
+    uint64_t num_slots;    // zero while the cache is being resized
+    uint64_t num_entries;
+    uint64_t heap_size;
+    uint64_t heap_capacity;
+    uint64_t reserved[2];
+};
+
+struct CacheSlot {
+    uint64_t hash;
+    uint64_t offset;
+};
+
+static inline CacheHeader* header(char* data) {
+    return reinterpret_cast<CacheHeader*>(data);
+}
+
+static inline CacheSlot* slots(char* data) {
+    return reinterpret_cast<CacheSlot*>(data + sizeof(CacheHeader));
+}
+
+static inline char* heap(char* data) {
+    return data + sizeof(CacheHeader) +
+           header(data)->num_slots * sizeof(CacheSlot);
+}
+
+static inline size_t file_size(uint64_t num_slots, uint64_t heap_capacity) {
+    return sizeof(CacheHeader) + num_slots * sizeof(CacheSlot) + heap_capacity;
+}
+
+static inline size_t entry_size(size_t inflen, size_t lemlen) {
+    return 2 * sizeof(uint32_t) + inflen + lemlen;
+}
+
+// 64-bit FNV-1a hash. the hash is stored in the cache file, so it must
+// not depend on the standard library implementation like std::hash does.
+static inline uint64_t word_hash(std::string const& s) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i=0 ; i<s.size() ; ++i) {
+        h ^= static_cast<unsigned char>(s[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// LemmaCache methods
+///////////////////////////////////////////////////////////////////////////////
+
+LemmaCache::LemmaCache(std::string const& filename, uint64_t model_hash) :
+    _fd(-1), _data(0), _size(0), _hits(0), _misses(0)
+{
+    _fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (_fd < 0) {
+        throw std::runtime_error("Could not open cache file " + filename);
+    }
+    if (flock(_fd, LOCK_EX | LOCK_NB) != 0) {
+        close(_fd);
+        throw std::runtime_error("Cache file " + filename +
+                                 " is in use by another process");
+    }
+    struct stat st;
+    if (fstat(_fd, &st) != 0) {
+        close(_fd);
+        throw std::runtime_error("Could not stat cache file " + filename);
+    }
+    // validate the existing contents, start from scratch if anything is off
+    try {
+        open_contents(st.st_size, model_hash);
+    } catch (...) {
+        unmap();
+        close(_fd);
+        throw;
+    }
+}
+
+void LemmaCache::open_contents(size_t size, uint64_t model_hash) {
+    bool valid = false;
+    if (size >= sizeof(CacheHeader)) {
+        map(size);
+        CacheHeader const* h = header(_data);
+        valid = memcmp(h->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+                h->model_hash == model_hash &&
+                h->num_slots != 0 &&
+                (h->num_slots & (h->num_slots - 1)) == 0 &&
+                h->heap_size <= h->heap_capacity &&
+                h->num_slots <= _size / sizeof(CacheSlot) &&
+                h->heap_capacity <= _size &&
+                file_size(h->num_slots, h->heap_capacity) == _size &&
+                h->num_entries * 2 <= h->num_slots &&
+                check_entries();
+    }
+    if (!valid) {
+        reset(model_hash);
+    }
+}
+
+bool LemmaCache::check_entries() const {
+    CacheHeader const* h = header(_data);
+    char const* p = heap(_data);
+    // every heap entry must fit in the used part of the heap, as grow()
+    // walks them to rebuild the slot array
+    uint64_t num_heap_entries = 0;
+    for (uint64_t offset=HEAP_START ; offset<h->heap_size ; ) {
+        uint32_t inflen, lemlen;
+        if (h->heap_size - offset < 2 * sizeof(uint32_t)) {
+            return false;
+        }
+        memcpy(&inflen, p + offset, sizeof(inflen));
+        memcpy(&lemlen, p + offset + sizeof(inflen), sizeof(lemlen));
+        if (h->heap_size - offset < entry_size(inflen, lemlen)) {
+            return false;
+        }
+        offset += entry_size(inflen, lemlen);
+        ++num_heap_entries;
+    }
+    // every slot must point to an entry within the heap, and the count of
+    // used slots must leave empty ones to end the probing in find()
+    CacheSlot const* s = slots(_data);
+    uint64_t num_used = 0;
+    for (uint64_t i=0 ; i<h->num_slots ; ++i) {
+        uint64_t offset = s[i].offset;
+        if (offset == 0) {
+            continue;
+        }
+        uint32_t inflen, lemlen;
+        if (offset < HEAP_START || offset > h->heap_size ||
+            h->heap_size - offset < 2 * sizeof(uint32_t))
+        {
+            return false;
+        }
+        memcpy(&inflen, p + offset, sizeof(inflen));
+        memcpy(&lemlen, p + offset + sizeof(inflen), sizeof(lemlen));
+        if (h->heap_size - offset < entry_size(inflen, lemlen)) {
+            return false;
+        }
+        ++num_used;
+    }
+    return num_used == h->num_entries && num_heap_entries == h->num_entries;
+}
+
+LemmaCache::~LemmaCache() {
+    unmap();
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+// the old mapping is kept, if the new one can not be made
+void LemmaCache::map(size_t size) {
+    void* p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (p == MAP_FAILED) {
+        throw std::runtime_error("Could not map cache file to memory");
+    }
+    unmap();
+    _data = static_cast<char*>(p);
+    _size = size;
+}
+
+void LemmaCache::unmap() {
+    if (_data) {
+        munmap(_data, _size);
+        _data = 0;
+        _size = 0;
+    }
+}
+
+void LemmaCache::reset(uint64_t model_hash) {
+    unmap();
+    // truncating to zero first makes sure that all old data is gone. the
+    // blocks are allocated up front, as writing to a page of the mapping
+    // that the file system has no room for raises SIGBUS.
+    size_t size = file_size(INITIAL_SLOTS, INITIAL_HEAP);
+    if (ftruncate(_fd, 0) != 0 || posix_fallocate(_fd, 0, size) != 0) {
+        throw std::runtime_error("Could not resize cache file");
+    }
+    map(size);
+    CacheHeader* h = header(_data);
+    h->model_hash    = model_hash;
+    h->num_slots     = INITIAL_SLOTS;
+    h->num_entries   = 0;
+    h->heap_size     = HEAP_START;
+    h->heap_capacity = INITIAL_HEAP;
+    memcpy(h->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+}
+
+void LemmaCache::index(uint64_t hash, uint64_t offset) {
+    uint64_t mask = header(_data)->num_slots - 1;
+    CacheSlot* s = slots(_data);
+    uint64_t i = hash & mask;
+    while (s[i].offset != 0) {
+        i = (i + 1) & mask;
+    }
+    s[i].hash   = hash;
+    s[i].offset = offset;
+}
+
+void LemmaCache::grow(size_t min_heap_free) {
+    CacheHeader* h = header(_data);
+    uint64_t num_slots = h->num_slots;
+    uint64_t heap_capacity = h->heap_capacity;
+    uint64_t heap_size = h->heap_size;
+    // keep the load factor of the slot array below one half
+    while ((h->num_entries + 1) * 2 > num_slots) {
+        num_slots *= 2;
+    }
+    while (heap_capacity - heap_size < min_heap_free) {
+        heap_capacity *= 2;
+    }
+    // the heap moves when the slot array grows, so take a copy of it.
+    std::vector<char> old_heap(heap(_data), heap(_data) + heap_size);
+    // mark the file invalid, until it has been rebuilt. on failure the
+    // cache stays usable at its old size.
+    uint64_t const old_num_slots = h->num_slots;
+    h->num_slots = 0;
+    size_t size = file_size(num_slots, heap_capacity);
+    try {
+        if (posix_fallocate(_fd, 0, size) != 0) {
+            throw std::runtime_error("Could not resize cache file");
+        }
+        map(size);
+    } catch (...) {
+        header(_data)->num_slots = old_num_slots;
+        throw;
+    }
+    h = header(_data);
+    h->heap_capacity = heap_capacity;
+    h->num_slots = num_slots;
+    memset(slots(_data), 0, num_slots * sizeof(CacheSlot));
+    memcpy(heap(_data), &old_heap[0], heap_size);
+    // rebuild the slot array by walking the heap entries
+    char* p = heap(_data);
+    std::string inf;
+    for (uint64_t offset=HEAP_START ; offset<heap_size ; ) {
+        uint32_t inflen, lemlen;
+        memcpy(&inflen, p + offset, sizeof(inflen));
+        memcpy(&lemlen, p + offset + sizeof(inflen), sizeof(lemlen));
+        inf.assign(p + offset + 2*sizeof(uint32_t), inflen);
+        index(word_hash(inf), offset);
+        offset += entry_size(inflen, lemlen);
+    }
+}
+
+bool LemmaCache::find(std::string const& inflected, std::string& lemma) {
+    CacheHeader const* h = header(_data);
+    uint64_t const mask = h->num_slots - 1;
+    uint64_t const hash = word_hash(inflected);
+    CacheSlot const* s = slots(_data);
+    char const* p = heap(_data);
+    for (uint64_t i = hash & mask ; s[i].offset != 0 ; i = (i + 1) & mask) {
+        if (s[i].hash != hash) {
+            continue;
+        }
+        uint32_t inflen, lemlen;
+        char const* e = p + s[i].offset;
+        memcpy(&inflen, e, sizeof(inflen));
+        memcpy(&lemlen, e + sizeof(inflen), sizeof(lemlen));
+        e += 2 * sizeof(uint32_t);
+        if (inflen == inflected.size() &&
+            memcmp(e, inflected.data(), inflen) == 0)
+        {
+            lemma.assign(e + inflen, lemlen);
+            ++_hits;
+            return true;
+        }
+    }
+    ++_misses;
+    return false;
+}
+
+void LemmaCache::insert(std::string const& inflected, std::string const& lemma)
+{
+    size_t const esize = entry_size(inflected.size(), lemma.size());
+    CacheHeader* h = header(_data);
+    if ((h->num_entries + 1) * 2 > h->num_slots ||
+        h->heap_capacity - h->heap_size < esize)
+    {
+        grow(esize);
+        h = header(_data);
+    }
+    uint64_t offset = h->heap_size;
+    uint32_t inflen = inflected.size();
+    uint32_t lemlen = lemma.size();
+    char* e = heap(_data) + offset;
+    memcpy(e, &inflen, sizeof(inflen));
+    memcpy(e + sizeof(inflen), &lemlen, sizeof(lemlen));
+    e += 2 * sizeof(uint32_t);
+    memcpy(e, inflected.data(), inflen);
+    memcpy(e + inflen, lemma.data(), lemlen);
+    index(word_hash(inflected), offset);
+    h->heap_size += esize;
+    h->num_entries += 1;
+}
+
+long LemmaCache::size() const {
+    return header(_data)->num_entries;
+}
+
+} // namespace suflem
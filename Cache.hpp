@@ -0,0 +1,75 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef CACHE_HPP_INCLUDED
+#define CACHE_HPP_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <stdexcept>
+
+namespace suflem {
+
+/// Persistent cache of lemmatization results.
+/// The cache is an open addressing hash table in a memory mapped file,
+/// that is bound to the fingerprint of a single model. Opening the cache
+/// with a different model fingerprint discards all cached results.
+/// Only one process can use a cache file at a time.
+class LemmaCache {
+    int _fd;
+    char* _data;
+    size_t _size;
+    long _hits;
+    long _misses;
+
+    LemmaCache(LemmaCache const&);
+    LemmaCache& operator=(LemmaCache const&);
+
+    void open_contents(size_t size, uint64_t model_hash);
+    void map(size_t size);
+    void unmap();
+    void reset(uint64_t model_hash);
+    void grow(size_t min_heap_free);
+    void index(uint64_t hash, uint64_t offset);
+    bool check_entries() const;
+
+public:
+    /// Open or create a cache file.
+    /// \param filename The path of the cache file.
+    /// \param model_hash The fingerprint of the model, see Model::fingerprint().
+    LemmaCache(std::string const& filename, uint64_t model_hash);
+    ~LemmaCache();
+
+    /// Look up a cached lemma.
+    /// \param inflected The inflected form of a word.
+    /// \param lemma Set to the cached lemma, if found.
+    /// \return true, if the word was found in the cache.
+    bool find(std::string const& inflected, std::string& lemma);
+
+    /// Store a lemmatization result in the cache.
+    void insert(std::string const& inflected, std::string const& lemma);
+
+    /// Number of results stored in the cache.
+    long size() const;
+    /// Number of successful lookups since the cache was opened.
+    long hits() const { return _hits; }
+    /// Number of failed lookups since the cache was opened.
+    long misses() const { return _misses; }
+};
+
+} //namespace suflem
+
+#endif // CACHE_HPP_INCLUDED
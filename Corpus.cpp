@@ -0,0 +1,206 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Corpus.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace suflem {
+
+///////////////////////////////////////////////////////////////////////////////
+// Miscellaneous functions
+///////////////////////////////////////////////////////////////////////////////
+
+// letters of the synthetic language, the others are two bytes in utf-8
+static char const* const ASCII_LETTERS = "abdeghijklmnoprstuv";
+static char const* const OTHER_LETTERS[] = {
+    "õ", "ä", "ö", "ü", "š", "ž", "é", "ñ", "ç", "ł", "ę", "ж", "я", "ы"
+};
+
+// the splitmix64 generator. the standard library distributions differ
+// between implementations, so random numbers are derived by hand.
+static inline uint64_t next(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// uniform in [0, 1)
+static inline double uniform(uint64_t& state) {
+    return (next(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// state of the generator for item `index` of a kind of items
+static inline uint64_t item_state(uint64_t seed, uint64_t kind,
+                                  uint64_t index)
+{
+    uint64_t state = seed ^ (kind << 56);
+    next(state);
+    state ^= index;
+    next(state);
+    return state;
+}
+
+// a rank in [0, n) with probability roughly proportional to 1/(rank+1),
+// using the inverse of the continuous distribution
+static inline long zipf_rank(uint64_t& state, long n) {
+    long rank = static_cast<long>(exp(uniform(state) * log(n + 1.0))) - 1;
+    return std::max(0L, std::min(n - 1, rank));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CorpusGenerator methods
+///////////////////////////////////////////////////////////////////////////////
+
+CorpusGenerator::CorpusGenerator(CorpusOptions const& opts) : _opts(opts) {
+    if (opts.vocabulary < 1 || opts.paradigms < 1 || opts.forms < 1) {
+        throw std::runtime_error("Vocabulary, paradigms and forms must be "
+                                 "positive.");
+    }
+    if (opts.min_suffix < 0 || opts.max_suffix < opts.min_suffix) {
+        throw std::runtime_error("Invalid range of suffix lengths.");
+    }
+    double weight = 1.0;
+    for (long l=opts.min_suffix ; l<=opts.max_suffix ; ++l) {
+        _suffix_weights.push_back(weight);
+        weight *= opts.suffix_decay;
+    }
+    _paradigms.resize(opts.paradigms);
+    for (long p=0 ; p<opts.paradigms ; ++p) {
+        uint64_t state = item_state(opts.seed, 1, p);
+        Paradigm& paradigm = _paradigms[p];
+        // most paradigms only replace endings, some change the stem too
+        double u = uniform(state);
+        paradigm.cut = u < 0.7 ? 0 : u < 0.9 ? 1 : 2;
+        for (long f=0 ; f<opts.forms ; ++f) {
+            paradigm.endings.push_back(ending(state));
+        }
+    }
+}
+
+std::string CorpusGenerator::letter(uint64_t& state) const {
+    size_t const num_other = sizeof(OTHER_LETTERS) / sizeof(OTHER_LETTERS[0]);
+    if (uniform(state) < _opts.non_ascii) {
+        return OTHER_LETTERS[next(state) % num_other];
+    }
+    return std::string(1, ASCII_LETTERS[next(state) % strlen(ASCII_LETTERS)]);
+}
+
+std::string CorpusGenerator::ending(uint64_t& state) const {
+    double sum = 0;
+    for (size_t i=0 ; i<_suffix_weights.size() ; ++i) {
+        sum += _suffix_weights[i];
+    }
+    double u = uniform(state) * sum;
+    long length = _opts.max_suffix;
+    for (size_t i=0 ; i<_suffix_weights.size() ; ++i) {
+        if (u < _suffix_weights[i]) {
+            length = _opts.min_suffix + i;
+            break;
+        }
+        u -= _suffix_weights[i];
+    }
+    std::string s;
+    for (long i=0 ; i<length ; ++i) {
+        s += letter(state);
+    }
+    return s;
+}
+
+void CorpusGenerator::lemma(long index, std::string& stem,
+                            std::string& short_stem,
+                            Paradigm const*& paradigm) const
+{
+    uint64_t state = item_state(_opts.seed, 2, index);
+    paradigm = &_paradigms[zipf_rank(state, _opts.paradigms)];
+    long const length = 3 + next(state) % 7;
+    stem.clear();
+    for (long i=0 ; i<length ; ++i) {
+        if (i == length - paradigm->cut) {
+            short_stem = stem;
+        }
+        stem += letter(state);
+    }
+    if (paradigm->cut == 0) {
+        short_stem = stem;
+    }
+}
+
+void CorpusGenerator::form(std::string const& stem,
+                           std::string const& short_stem,
+                           Paradigm const& paradigm, long f,
+                           std::string& out) const
+{
+    out.append(f == 0 ? stem : short_stem);
+    out.append(paradigm.endings[f]);
+}
+
+long CorpusGenerator::training(FILE* out) const {
+    std::string buffer;
+    std::string stem, short_stem;
+    Paradigm const* paradigm;
+    long lines = 0;
+    for (long i=0 ; i<_opts.vocabulary ; ++i) {
+        lemma(i, stem, short_stem, paradigm);
+        for (long f=0 ; f<_opts.forms ; ++f) {
+            form(stem, short_stem, *paradigm, f, buffer);
+            buffer.push_back('\t');
+            form(stem, short_stem, *paradigm, 0, buffer);
+            // frequent lemmas and forms get the large counts
+            long count = 1 + static_cast<long>(1e6 / ((i + 1.0) * (f + 1)));
+            buffer.push_back('\t');
+            buffer.append(std::to_string(count));
+            buffer.push_back('\n');
+            ++lines;
+        }
+        if (buffer.size() >= (1 << 16)) {
+            fwrite(buffer.data(), 1, buffer.size(), out);
+            buffer.clear();
+        }
+    }
+    fwrite(buffer.data(), 1, buffer.size(), out);
+    if (ferror(out)) {
+        throw std::runtime_error("Could not write training data.");
+    }
+    return lines;
+}
+
+void CorpusGenerator::tokens(FILE* out, long count) const {
+    uint64_t state = item_state(_opts.seed, 3, 0);
+    std::string buffer;
+    std::string stem, short_stem;
+    Paradigm const* paradigm;
+    for (long t=0 ; t<count ; ++t) {
+        lemma(zipf_rank(state, _opts.vocabulary), stem, short_stem, paradigm);
+        form(stem, short_stem, *paradigm, zipf_rank(state, _opts.forms),
+             buffer);
+        buffer.push_back('\n');
+        if (buffer.size() >= (1 << 16)) {
+            fwrite(buffer.data(), 1, buffer.size(), out);
+            buffer.clear();
+        }
+    }
+    fwrite(buffer.data(), 1, buffer.size(), out);
+    if (ferror(out)) {
+        throw std::runtime_error("Could not write tokens.");
+    }
+}
+
+} // namespace suflem
@@ -0,0 +1,82 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef CORPUS_HPP_INCLUDED
+#define CORPUS_HPP_INCLUDED
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+namespace suflem {
+
+/// Parameters of a synthetic language.
+struct CorpusOptions {
+    long vocabulary;      ///< number of lemmas
+    long paradigms;       ///< number of inflection classes
+    long forms;           ///< inflected forms in every paradigm
+    long min_suffix;      ///< shortest ending in code points
+    long max_suffix;      ///< longest ending in code points
+    double suffix_decay;  ///< each longer ending is this much less likely
+    double non_ascii;     ///< share of letters outside ASCII
+    uint64_t seed;
+
+    CorpusOptions() :
+        vocabulary(100000), paradigms(50), forms(12), min_suffix(1),
+        max_suffix(6), suffix_decay(0.6), non_ascii(0.1), seed(1)
+    { }
+};
+
+/// Generates training data and token streams of a synthetic language.
+/// Lemmas are random stems of one of the paradigms. A paradigm replaces the
+/// ending of the lemma, sometimes together with the final letters of the
+/// stem, with its own ending for each form. Lemmas and forms are used with
+/// Zipfian frequencies. Every lemma and paradigm is derived from the seed
+/// and its index alone, so the output is the same on every platform and
+/// the memory used does not grow with the vocabulary.
+class CorpusGenerator {
+    struct Paradigm {
+        long cut;  // stem letters replaced by the endings
+        std::vector<std::string> endings;  // the lemma ending first
+    };
+
+    CorpusOptions _opts;
+    std::vector<Paradigm> _paradigms;
+    std::vector<double> _suffix_weights;
+
+    std::string letter(uint64_t& state) const;
+    std::string ending(uint64_t& state) const;
+    void lemma(long index, std::string& stem, std::string& short_stem,
+               Paradigm const*& paradigm) const;
+    void form(std::string const& stem, std::string const& short_stem,
+              Paradigm const& paradigm, long f, std::string& out) const;
+
+public:
+    explicit CorpusGenerator(CorpusOptions const& opts);
+
+    /// Write every form of every lemma as `inflected<TAB>lemma<TAB>count`.
+    /// \return The number of lines written.
+    long training(FILE* out) const;
+
+    /// Write `count` tokens drawn with Zipfian frequencies, one per line.
+    void tokens(FILE* out, long count) const;
+};
+
+} //namespace suflem
+
+#endif // CORPUS_HPP_INCLUDED
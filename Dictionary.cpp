@@ -0,0 +1,115 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Dictionary.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace suflem {
+
+LemmaDictionary::LemmaDictionary() : _saved(0)
+{ }
+
+LemmaDictionary::LemmaDictionary(std::string const& filename) : _saved(0) {
+    FILE* fin = fopen(filename.c_str(), "rb");
+    if (!fin) {
+        throw std::runtime_error("Could not open file " + filename);
+    }
+    char* line = 0;
+    size_t capacity = 0;
+    ssize_t size;
+    while ((size = getline(&line, &capacity, fin)) >= 0) {
+        if (size > 0 && line[size-1] == '\n') {
+            --size;
+        }
+        std::string lemma(line, size);
+        if (!_ids.insert(std::make_pair(lemma, _lemmas.size())).second) {
+            free(line);
+            fclose(fin);
+            throw std::runtime_error("Duplicate lemma on line "
+                                     + std::to_string(_lemmas.size() + 1)
+                                     + " of " + filename);
+        }
+        _lemmas.push_back(lemma);
+    }
+    free(line);
+    bool const error = !feof(fin);
+    fclose(fin);
+    if (error) {
+        throw std::runtime_error("Could not read file " + filename);
+    }
+    _saved = _lemmas.size();
+}
+
+long LemmaDictionary::id(std::string const& lemma) {
+    auto it = _ids.find(lemma);
+    if (it != _ids.end()) {
+        return it->second;
+    }
+    if (lemma.find('\n') != std::string::npos) {
+        throw std::runtime_error("Lemmas with newlines can not be stored.");
+    }
+    long id = _lemmas.size();
+    _ids.insert(std::make_pair(lemma, id));
+    _lemmas.push_back(lemma);
+    return id;
+}
+
+long LemmaDictionary::find(std::string const& lemma) const {
+    auto it = _ids.find(lemma);
+    return it != _ids.end() ? it->second : -1;
+}
+
+// write the lemmas from index `begin` on to `fout`, one per line, and close it
+static void write_lemmas(FILE* fout, std::vector<std::string> const& lemmas,
+                         size_t begin, std::string const& filename)
+{
+    for (size_t i=begin ; i<lemmas.size() ; ++i) {
+        fwrite(lemmas[i].data(), 1, lemmas[i].size(), fout);
+        fputc('\n', fout);
+    }
+    bool const error = ferror(fout);
+    if (fclose(fout) != 0 || error) {
+        throw std::runtime_error("Could not write dictionary to " + filename);
+    }
+}
+
+void LemmaDictionary::save(std::string const& filename) {
+    FILE* fout = fopen(filename.c_str(), "wb");
+    if (!fout) {
+        throw std::runtime_error("Could not open file "
+                                 + filename + " for writing");
+    }
+    write_lemmas(fout, _lemmas, 0, filename);
+    _saved = _lemmas.size();
+}
+
+void LemmaDictionary::append(std::string const& filename) {
+    if (_saved == _lemmas.size()) {
+        return;
+    }
+    FILE* fout = fopen(filename.c_str(), "ab");
+    if (!fout) {
+        throw std::runtime_error("Could not open file "
+                                 + filename + " for writing");
+    }
+    write_lemmas(fout, _lemmas, _saved, filename);
+    _saved = _lemmas.size();
+}
+
+} // namespace suflem
@@ -0,0 +1,66 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef DICTIONARY_HPP_INCLUDED
+#define DICTIONARY_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+
+namespace suflem {
+
+/// Dense integer IDs of lemmas.
+/// IDs are assigned from 0 upwards in the order the lemmas are first seen.
+/// In the dictionary file, each line holds a lemma and its line number,
+/// counted from 0, is its ID. Lemmas may not contain newlines.
+/// The dictionary is not synchronized, threads sharing one must lock it.
+class LemmaDictionary {
+    std::unordered_map<std::string, long> _ids;
+    std::vector<std::string> _lemmas;
+    size_t _saved;  // number of lemmas already in the file
+
+public:
+    /// Create an empty dictionary.
+    LemmaDictionary();
+    /// Load a dictionary from file.
+    explicit LemmaDictionary(std::string const& filename);
+
+    /// Get the ID of a lemma, assigning the next free ID to new lemmas.
+    long id(std::string const& lemma);
+    /// Get the ID of a lemma without assigning new ones.
+    /// \return The ID or -1, if the lemma is not in the dictionary.
+    long find(std::string const& lemma) const;
+    /// Get the lemma of an ID.
+    std::string const& lemma(long id) const { return _lemmas.at(id); }
+
+    /// Number of lemmas in the dictionary.
+    size_t size() const { return _lemmas.size(); }
+    /// Number of lemmas added since the dictionary was loaded or saved.
+    size_t added() const { return _lemmas.size() - _saved; }
+
+    /// Write the whole dictionary to a file.
+    void save(std::string const& filename);
+    /// Append the lemmas added since the dictionary was loaded or saved to
+    /// the file it was loaded from, creating the file if necessary.
+    /// Cheaper than save() for dictionaries that are built incrementally.
+    void append(std::string const& filename);
+};
+
+} //namespace suflem
+
+#endif // DICTIONARY_HPP_INCLUDED
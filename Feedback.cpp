@@ -0,0 +1,257 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Feedback.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+
+namespace suflem {
+
+FeedbackModel::FeedbackModel(SharedModel& target,
+                             std::string const& log_path,
+                             long interval) :
+    _target(target), _log_path(log_path), _interval(interval),
+    _pending(0), _stopping(false)
+{
+    if (_interval < 1) {
+        throw std::runtime_error("Feedback interval must be positive.");
+    }
+    if (_log_path.size() > 0) {
+        // apply the examples of earlier runs
+        std::string text;
+        if (FILE* fin = fopen(_log_path.c_str(), "rb")) {
+            char buf[1 << 16];
+            size_t n;
+            while ((n = fread(buf, 1, sizeof(buf), fin)) > 0) {
+                text.append(buf, n);
+            }
+            fclose(fin);
+        }
+        std::vector<Example> examples;
+        parse(text, examples);
+        if (examples.size() > 0) {
+            fprintf(stderr, "Applying %ld examples from %s.\n",
+                    static_cast<long>(examples.size()), _log_path.c_str());
+            std::lock_guard<std::mutex> lock(_mutex);
+            rebuild();
+            apply(examples);
+            _examples = examples;
+            _pending = _examples.size();
+        }
+    }
+    publish();
+    _publisher = std::thread(&FeedbackModel::run, this);
+}
+
+FeedbackModel::~FeedbackModel() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wakeup.notify_all();
+    _publisher.join();
+}
+
+void FeedbackModel::rebuild() {
+    SharedModel::Snapshot base = _target.get();
+    _shadow.reset(new Model(*base));
+    _base = base;
+    for (size_t i=0 ; i<_examples.size() ; ++i) {
+        _shadow->feedback(_examples[i].inflected, _examples[i].lemma,
+                          _examples[i].count);
+    }
+    _pending = _examples.size();
+}
+
+bool FeedbackModel::is_stale() const {
+    SharedModel::Snapshot current = _target.get();
+    return !_shadow || (_base.lock() != current &&
+                        _replacing.lock() != current);
+}
+
+void FeedbackModel::apply(std::vector<Example> const& examples)
+{
+    size_t i = 0;
+    try {
+        for ( ; i<examples.size() ; ++i) {
+            _shadow->feedback(examples[i].inflected, examples[i].lemma,
+                              examples[i].count);
+        }
+    } catch (std::exception& e) {
+        // take back the examples applied so far
+        while (i-- > 0) {
+            _shadow->feedback(examples[i].inflected, examples[i].lemma,
+                              -examples[i].count);
+        }
+        throw;
+    }
+}
+
+void FeedbackModel::add(std::vector<Example> const& examples)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (is_stale()) {
+        rebuild();
+    }
+    apply(examples);
+    if (_log_path.size() > 0) {
+        std::string text;
+        for (size_t i=0 ; i<examples.size() ; ++i) {
+            text += examples[i].inflected + '\t' + examples[i].lemma + '\t' +
+                    std::to_string(examples[i].count) + '\n';
+        }
+        FILE* fout = fopen(_log_path.c_str(), "ab");
+        bool ok = fout && fwrite(text.data(), 1, text.size(), fout) ==
+                          text.size();
+        if (fout && fclose(fout) != 0) {
+            ok = false;
+        }
+        if (!ok) {
+            for (size_t i=0 ; i<examples.size() ; ++i) {
+                _shadow->feedback(examples[i].inflected, examples[i].lemma,
+                                  -examples[i].count);
+            }
+            throw std::runtime_error("Could not write to " + _log_path);
+        }
+    }
+    _examples.insert(_examples.end(), examples.begin(), examples.end());
+    _pending += examples.size();
+}
+
+bool FeedbackModel::publish() {
+    std::lock_guard<std::mutex> publish_lock(_publish_mutex);
+    std::shared_ptr<Model> model;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (is_stale()) {
+            if (_examples.size() == 0) {
+                return false;
+            }
+            rebuild();
+        }
+        if (_pending == 0) {
+            return false;
+        }
+        model = std::make_shared<Model>(*_shadow);
+        _pending = 0;
+    }
+    // trimming a large model takes a while, examples can still be added
+    model->trim();
+
+    // the shadow model is based on the new model from now on. while the
+    // replaced model is still current, adders do not count the shadow
+    // model as stale, so the lock is not held while replace() waits for
+    // the readers of the old model.
+    SharedModel::Snapshot expected;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        expected = _base.lock();
+        _base = model;
+        _replacing = expected;
+    }
+    bool replaced = _target.replace(std::move(expected), model);
+
+    // the examples are marked published only if the model was not reloaded
+    // meanwhile
+    std::lock_guard<std::mutex> lock(_mutex);
+    _replacing.reset();
+    if (!replaced) {
+        rebuild();
+        return false;
+    }
+    return true;
+}
+
+long FeedbackModel::size() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _examples.size();
+}
+
+long FeedbackModel::pending() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _pending;
+}
+
+void FeedbackModel::run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stopping) {
+        _wakeup.wait_for(lock, std::chrono::seconds(_interval));
+        if (_stopping) {
+            continue;
+        }
+        // publish() also reapplies the examples after a reload
+        lock.unlock();
+        try {
+            publish();
+        } catch (std::exception& e) {
+            fprintf(stderr, "Publishing feedback failed: %s\n", e.what());
+        }
+        lock.lock();
+    }
+}
+
+void FeedbackModel::parse(std::string const& text,
+                          std::vector<Example>& examples)
+{
+    examples.clear();
+    long lineno = 0;
+    for (size_t begin=0 ; begin<text.size() ; ) {
+        size_t end = text.find('\n', begin);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string line = text.substr(begin, end - begin);
+        begin = end + 1;
+        ++lineno;
+        if (line.size() > 0 && line[line.size()-1] == '\r') {
+            line.resize(line.size() - 1);
+        }
+        if (line.size() == 0) {
+            continue;
+        }
+        size_t tab1 = line.find('\t');
+        size_t tab2 = tab1 == std::string::npos ? tab1 :
+                      line.find('\t', tab1 + 1);
+        Example e;
+        e.inflected = line.substr(0, tab1);
+        e.count = 1;
+        if (tab1 != std::string::npos) {
+            e.lemma = line.substr(tab1 + 1, tab2 - (tab1 + 1));
+        }
+        if (tab2 != std::string::npos) {
+            char* rest;
+            e.count = strtol(line.c_str() + tab2 + 1, &rest, 10);
+            if (*rest != '\0' || rest == line.c_str() + tab2 + 1) {
+                e.count = 0;
+            }
+        }
+        if (e.inflected.size() == 0 || e.lemma.size() == 0) {
+            throw std::runtime_error("Zero-length string on line " +
+                                     std::to_string(lineno));
+        }
+        if (e.count <= 0) {
+            throw std::runtime_error("Invalid count on line " +
+                                     std::to_string(lineno));
+        }
+        examples.push_back(e);
+    }
+}
+
+} // namespace suflem
@@ -0,0 +1,101 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef FEEDBACK_HPP_INCLUDED
+#define FEEDBACK_HPP_INCLUDED
+
+#include "SharedModel.hpp"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdexcept>
+
+namespace suflem {
+
+/// Corrections to a served model, applied while it is being used.
+/// Examples are added to an untrimmed shadow copy of the served model.
+/// Every `interval` seconds, if there were new examples, a trimmed copy
+/// of the shadow model is published, so readers of the SharedModel never
+/// wait for writers. When the served model is reloaded, the shadow model
+/// is rebuilt from the new model and all examples are applied again.
+class FeedbackModel {
+public:
+    /// A corrected word.
+    struct Example {
+        std::string inflected;
+        std::string lemma;
+        long count;
+    };
+
+private:
+    SharedModel& _target;
+    std::string _log_path;
+    long _interval;
+    std::unique_ptr<Model> _shadow;    // created on first example
+    std::weak_ptr<Model const> _base;  // served model the shadow is based on
+    std::weak_ptr<Model const> _replacing;  // replaced by _base in publish()
+    std::vector<Example> _examples;    // all examples, for rebuilding
+    long _pending;                     // examples not yet published
+    bool _stopping;
+    std::mutex _mutex;
+    std::mutex _publish_mutex;
+    std::condition_variable _wakeup;
+    std::thread _publisher;
+
+    FeedbackModel(FeedbackModel const&);
+    FeedbackModel& operator=(FeedbackModel const&);
+
+    bool is_stale() const;
+    void rebuild();
+    void apply(std::vector<Example> const& examples);
+    void run();
+
+public:
+    /// \param target The served model to correct.
+    /// \param log_path If not empty, accepted examples are appended to
+    ///                 this file in training data format, and the examples
+    ///                 already in the file are applied on construction.
+    /// \param interval Seconds between publishing new corrections.
+    FeedbackModel(SharedModel& target,
+                  std::string const& log_path="",
+                  long interval=10);
+    ~FeedbackModel();
+
+    /// Add a batch of examples.
+    /// Either all or none of the examples are applied.
+    void add(std::vector<Example> const& examples);
+
+    /// Publish the corrections added so far without waiting.
+    /// \return false, if there was nothing to publish.
+    bool publish();
+
+    /// Number of examples added so far.
+    long size();
+    /// Number of examples not published yet.
+    long pending();
+
+    /// Parse examples in training data format: inflected form, lemma and
+    /// optional count (default 1) separated by tabs, one per line.
+    static void parse(std::string const& text, std::vector<Example>& examples);
+};
+
+} //namespace suflem
+
+#endif // FEEDBACK_HPP_INCLUDED
@@ -0,0 +1,329 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Http.hpp"
+#include "Json.hpp"
+#include "Protocol.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+namespace suflem {
+namespace http {
+
+// maximum size of the request line and headers
+size_t const MAX_HEADER_SIZE = 64 << 10;
+
+///////////////////////////////////////////////////////////////////////////////
+// Miscellaneous functions
+///////////////////////////////////////////////////////////////////////////////
+
+static char const* status_text(int status) {
+    switch (status) {
+        case 100: return "Continue";
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        case 505: return "HTTP Version Not Supported";
+    }
+    return "Unknown";
+}
+
+static inline bool iequals(std::string const& a, char const* b) {
+    return strcasecmp(a.c_str(), b) == 0;
+}
+
+static inline std::string strip(std::string const& s) {
+    size_t begin = s.find_first_not_of(" \t");
+    if (begin == std::string::npos) {
+        return std::string();
+    }
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+static void append_response(Response const& response, bool keep_alive,
+                            bool http10, std::string& out)
+{
+    char header[256];
+    snprintf(header, sizeof(header),
+             "HTTP/1.1 %d %s\r\n"
+             "Content-Type: %s\r\n"
+             "Content-Length: %lu\r\n",
+             response.status, status_text(response.status),
+             response.content_type.c_str(),
+             static_cast<unsigned long>(response.body.size()));
+    out.append(header);
+    if (!keep_alive) {
+        out.append("Connection: close\r\n");
+    } else if (http10) {
+        out.append("Connection: keep-alive\r\n");
+    }
+    out.append("\r\n");
+    out.append(response.body);
+}
+
+static void append_error(int status, std::string const& message,
+                         std::string& out)
+{
+    Response response;
+    response.status = status;
+    response.body = message + '\n';
+    append_response(response, false, false, out);
+}
+
+static void parse_json_array(std::string const& body,
+                             std::vector<std::string>& words)
+{
+    char const* p = body.data();
+    char const* end = p + body.size();
+    words.clear();
+    json::skip_space(p, end);
+    if (p == end || *p++ != '[') {
+        throw std::runtime_error("Expected a JSON array of strings.");
+    }
+    json::skip_space(p, end);
+    if (p < end && *p == ']') {
+        ++p;
+    } else {
+        while (true) {
+            json::skip_space(p, end);
+            if (p == end || *p++ != '"') {
+                throw std::runtime_error("Expected a JSON array of strings.");
+            }
+            words.push_back(std::string());
+            json::parse_string(p, end, words.back());
+            json::skip_space(p, end);
+            if (p < end && *p == ',') {
+                ++p;
+            } else if (p < end && *p == ']') {
+                ++p;
+                break;
+            } else {
+                throw std::runtime_error("Expected ',' or ']' in JSON array.");
+            }
+        }
+    }
+    json::skip_space(p, end);
+    if (p != end) {
+        throw std::runtime_error("Trailing data after JSON array.");
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Request parsing
+///////////////////////////////////////////////////////////////////////////////
+
+// Parses the requests of a single connection.
+class Connection {
+    Application _app;
+    bool _continue_sent;
+
+public:
+    Connection(Application const& app) : _app(app), _continue_sent(false) {}
+
+    size_t operator()(char const* in, size_t size, std::string& out,
+                      bool& close);
+};
+
+size_t Connection::operator()(char const* in, size_t size, std::string& out,
+                              bool& close)
+{
+    size_t consumed = 0;
+    Request request;
+    Response response;
+    while (!close && consumed < size) {
+        char const* begin = in + consumed;
+        size_t avail = size - consumed;
+        // locate the end of headers
+        char const* hend = static_cast<char const*>(
+            memmem(begin, avail, "\r\n\r\n", 4));
+        if (!hend) {
+            if (avail > MAX_HEADER_SIZE) {
+                append_error(431, "Request headers too large.", out);
+                close = true;
+            }
+            break;
+        }
+        std::string head(begin, hend - begin);
+        size_t const header_size = head.size() + 4;
+
+        // request line
+        size_t eol = head.find("\r\n");
+        std::string line = head.substr(0, eol);
+        size_t sp1 = line.find(' ');
+        size_t sp2 = line.rfind(' ');
+        if (sp1 == std::string::npos || sp1 == sp2) {
+            append_error(400, "Malformed request line.", out);
+            close = true;
+            break;
+        }
+        std::string version = line.substr(sp2 + 1);
+        if (version != "HTTP/1.1" && version != "HTTP/1.0") {
+            append_error(505, "Unsupported HTTP version.", out);
+            close = true;
+            break;
+        }
+        bool const http10 = version == "HTTP/1.0";
+        bool keep_alive = !http10;
+        request.method = line.substr(0, sp1);
+        std::string target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+        size_t q = target.find('?');
+        request.path = target.substr(0, q);
+        request.query = q == std::string::npos ? "" : target.substr(q + 1);
+        request.content_type.clear();
+
+        // headers
+        unsigned long content_length = 0;
+        bool expect_continue = false;
+        bool chunked = false;
+        while (eol != std::string::npos) {
+            size_t next = head.find("\r\n", eol + 2);
+            std::string header = head.substr(eol + 2, next == std::string::npos ?
+                                             std::string::npos :
+                                             next - eol - 2);
+            eol = next;
+            size_t colon = header.find(':');
+            if (colon == std::string::npos) {
+                continue;
+            }
+            std::string name = header.substr(0, colon);
+            std::string value = strip(header.substr(colon + 1));
+            if (iequals(name, "content-length")) {
+                content_length = strtoul(value.c_str(), 0, 10);
+            } else if (iequals(name, "content-type")) {
+                request.content_type = value;
+            } else if (iequals(name, "transfer-encoding")) {
+                chunked = !iequals(value, "identity");
+            } else if (iequals(name, "expect")) {
+                expect_continue = iequals(value, "100-continue");
+            } else if (iequals(name, "connection")) {
+                if (iequals(value, "close")) {
+                    keep_alive = false;
+                } else if (iequals(value, "keep-alive")) {
+                    keep_alive = true;
+                }
+            }
+        }
+        if (chunked) {
+            append_error(501, "Chunked request bodies are not supported.", out);
+            close = true;
+            break;
+        }
+        if (content_length > protocol::MAX_FRAME_SIZE) {
+            append_error(413, "Request body too large.", out);
+            close = true;
+            break;
+        }
+        // wait for the complete body
+        if (avail - header_size < content_length) {
+            if (expect_continue && !_continue_sent) {
+                out.append("HTTP/1.1 100 Continue\r\n\r\n");
+                _continue_sent = true;
+            }
+            break;
+        }
+        _continue_sent = false;
+        request.body.assign(hend + 4, content_length);
+        consumed += header_size + content_length;
+
+        response = Response();
+        try {
+            _app(request, response);
+        } catch (std::runtime_error& e) {
+            response = Response();
+            response.status = 400;
+            response.body = std::string(e.what()) + '\n';
+        }
+        append_response(response, keep_alive, http10, out);
+        if (!keep_alive) {
+            close = true;
+        }
+    }
+    return consumed;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Public functions
+///////////////////////////////////////////////////////////////////////////////
+
+Server::Handler handler(Application const& app) {
+    // std::function requires copyable targets, share the parser state
+    std::shared_ptr<Connection> c = std::make_shared<Connection>(app);
+    return [c](char const* in, size_t size, std::string& out, bool& close) {
+        return (*c)(in, size, out, close);
+    };
+}
+
+bool parse_words(Request const& request, std::vector<std::string>& words)
+{
+    if (request.content_type.find("application/json") != std::string::npos) {
+        parse_json_array(request.body, words);
+        return true;
+    }
+    words.clear();
+    std::string const& body = request.body;
+    size_t begin = 0;
+    while (begin < body.size()) {
+        size_t end = body.find('\n', begin);
+        if (end == std::string::npos) {
+            end = body.size();
+        }
+        size_t len = end - begin;
+        if (len > 0 && body[end-1] == '\r') {
+            --len;
+        }
+        words.push_back(body.substr(begin, len));
+        begin = end + 1;
+    }
+    return false;
+}
+
+void format_words(std::vector<std::string> const& words, bool json,
+                  Response& response)
+{
+    std::string& body = response.body;
+    body.clear();
+    if (json) {
+        response.content_type = "application/json";
+        body.push_back('[');
+        for (size_t i=0 ; i<words.size() ; ++i) {
+            if (i > 0) {
+                body.push_back(',');
+            }
+            json::append_string(words[i], body);
+        }
+        body.append("]\n");
+    } else {
+        response.content_type = "text/plain; charset=utf-8";
+        for (size_t i=0 ; i<words.size() ; ++i) {
+            body.append(words[i]);
+            body.push_back('\n');
+        }
+    }
+}
+
+} // namespace http
+} // namespace suflem
@@ -0,0 +1,75 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef HTTP_HPP_INCLUDED
+#define HTTP_HPP_INCLUDED
+
+#include "Server.hpp"
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+
+namespace suflem {
+
+/// Minimal HTTP/1.1 server side protocol for the Server class.
+/// Supports keep-alive connections, pipelined requests and request bodies
+/// with Content-Length. Chunked request bodies are not supported.
+namespace http {
+
+/// A parsed HTTP request.
+struct Request {
+    std::string method;
+    std::string path;
+    std::string query;
+    std::string content_type;
+    std::string body;
+};
+
+/// The response to a HTTP request.
+struct Response {
+    int status;
+    std::string content_type;
+    std::string body;
+
+    Response() : status(200), content_type("text/plain; charset=utf-8") {}
+};
+
+/// Application serving HTTP requests.
+/// A std::runtime_error thrown by the application is answered with
+/// status 400 and the error message.
+typedef std::function<void (Request const&, Response&)> Application;
+
+/// Create a connection handler serving `app` over HTTP/1.1.
+Server::Handler handler(Application const& app);
+
+/// Read a batch of words from a request body.
+/// The body is a JSON array of strings, when the content type is
+/// application/json, and one word per line otherwise.
+/// \return true, if the body was a JSON array.
+bool parse_words(Request const& request, std::vector<std::string>& words);
+
+/// Write a batch of words to a response body.
+/// \param json If true, the words are written as JSON array of strings,
+///             otherwise one word per line.
+void format_words(std::vector<std::string> const& words, bool json,
+                  Response& response);
+
+} // namespace http
+} // namespace suflem
+
+#endif // HTTP_HPP_INCLUDED
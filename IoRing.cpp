@@ -0,0 +1,193 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "IoRing.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace suflem {
+
+// glibc has no wrappers for the io_uring system calls
+static inline int io_uring_setup(unsigned entries, io_uring_params* p) {
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int io_uring_enter(int fd, unsigned to_submit,
+                                 unsigned min_complete, unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                   0, 0);
+}
+
+template <typename T>
+static inline T* ring_field(void* ring, unsigned offset) {
+    return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+IoRing::IoRing(unsigned entries) :
+    _fd(-1), _entries(0), _sq_ring(MAP_FAILED), _sq_ring_size(0),
+    _cq_ring(MAP_FAILED), _cq_ring_size(0),
+    _sqes(static_cast<io_uring_sqe*>(MAP_FAILED)), _sqes_size(0),
+    _queued(0)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    _fd = io_uring_setup(entries, &params);
+    if (_fd < 0) {
+        throw std::runtime_error(std::string("io_uring is not available: ")
+                                 + strerror(errno));
+    }
+    _entries = params.sq_entries;
+    _sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cq_ring_size = params.cq_off.cqes +
+                    params.cq_entries * sizeof(io_uring_cqe);
+    // newer kernels map both rings with one mmap
+    bool const single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && _cq_ring_size > _sq_ring_size) {
+        _sq_ring_size = _cq_ring_size;
+    }
+    _sq_ring = mmap(0, _sq_ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    if (_sq_ring != MAP_FAILED && single_mmap) {
+        _cq_ring = _sq_ring;
+    } else if (_sq_ring != MAP_FAILED) {
+        _cq_ring = mmap(0, _cq_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+    }
+    _sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    if (_cq_ring != MAP_FAILED) {
+        _sqes = static_cast<io_uring_sqe*>(
+            mmap(0, _sqes_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES));
+    }
+    if (_sqes == MAP_FAILED) {
+        std::string error = strerror(errno);
+        unmap();
+        throw std::runtime_error("Could not map io_uring: " + error);
+    }
+
+    _sq_head = ring_field<unsigned>(_sq_ring, params.sq_off.head);
+    _sq_tail = ring_field<unsigned>(_sq_ring, params.sq_off.tail);
+    _sq_mask = ring_field<unsigned>(_sq_ring, params.sq_off.ring_mask);
+    _sq_array = ring_field<unsigned>(_sq_ring, params.sq_off.array);
+    _cq_head = ring_field<unsigned>(_cq_ring, params.cq_off.head);
+    _cq_tail = ring_field<unsigned>(_cq_ring, params.cq_off.tail);
+    _cq_mask = ring_field<unsigned>(_cq_ring, params.cq_off.ring_mask);
+    _cqes = ring_field<io_uring_cqe>(_cq_ring, params.cq_off.cqes);
+}
+
+IoRing::~IoRing() {
+    unmap();
+}
+
+void IoRing::unmap() {
+    if (_sqes != MAP_FAILED) {
+        munmap(_sqes, _sqes_size);
+    }
+    if (_cq_ring != MAP_FAILED && _cq_ring != _sq_ring) {
+        munmap(_cq_ring, _cq_ring_size);
+    }
+    if (_sq_ring != MAP_FAILED) {
+        munmap(_sq_ring, _sq_ring_size);
+    }
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+io_uring_sqe* IoRing::next_sqe() {
+    unsigned const head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+    unsigned const tail = *_sq_tail + _queued;
+    if (tail - head >= _entries) {
+        throw std::runtime_error("io_uring submission queue is full.");
+    }
+    unsigned const index = tail & *_sq_mask;
+    io_uring_sqe* sqe = &_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    _sq_array[index] = index;
+    ++_queued;
+    return sqe;
+}
+
+void IoRing::read(int fd, void* buffer, unsigned size, uint64_t offset,
+                  uint64_t user_data)
+{
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+}
+
+void IoRing::write(int fd, void const* buffer, unsigned size, uint64_t offset,
+                   uint64_t user_data)
+{
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+}
+
+void IoRing::submit(unsigned wait) {
+    // publish the queued entries to the kernel. entries it did not consume
+    // in an earlier call are submitted again.
+    unsigned const tail = *_sq_tail + _queued;
+    __atomic_store_n(_sq_tail, tail, __ATOMIC_RELEASE);
+    _queued = 0;
+    unsigned to_submit = tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+    while (true) {
+        int r = io_uring_enter(_fd, to_submit, wait,
+                               wait > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        } else if (r < 0) {
+            throw std::runtime_error(std::string("io_uring_enter failed: ")
+                                     + strerror(errno));
+        }
+        to_submit -= std::min<unsigned>(r, to_submit);
+        if (to_submit == 0 || wait > 0) {
+            return;
+        }
+    }
+}
+
+bool IoRing::complete(uint64_t& user_data, int& result) {
+    unsigned const head = *_cq_head;
+    if (head == __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    io_uring_cqe const& cqe = _cqes[head & *_cq_mask];
+    user_data = cqe.user_data;
+    result = cqe.res;
+    __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+} // namespace suflem
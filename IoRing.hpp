@@ -0,0 +1,89 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef IORING_HPP_INCLUDED
+#define IORING_HPP_INCLUDED
+
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+
+#include <linux/io_uring.h>
+
+namespace suflem {
+
+/// Minimal io_uring submission and completion queue for reads and writes.
+/// Uses the system calls directly, no library is needed. Not thread safe,
+/// a ring is meant to be driven by a single I/O thread.
+/// The caller must not have more requests in flight than the ring has
+/// entries.
+class IoRing {
+    int _fd;
+    unsigned _entries;
+    void* _sq_ring;
+    size_t _sq_ring_size;
+    void* _cq_ring;
+    size_t _cq_ring_size;
+    io_uring_sqe* _sqes;
+    size_t _sqes_size;
+
+    unsigned* _sq_head;
+    unsigned* _sq_tail;
+    unsigned* _sq_mask;
+    unsigned* _sq_array;
+    unsigned* _cq_head;
+    unsigned* _cq_tail;
+    unsigned* _cq_mask;
+    io_uring_cqe* _cqes;
+    unsigned _queued;  // requests queued, but not submitted yet
+
+    IoRing(IoRing const&);
+    IoRing& operator=(IoRing const&);
+
+    io_uring_sqe* next_sqe();
+    void unmap();
+
+public:
+    /// Set up a ring.
+    /// \param entries The maximum number of requests in flight.
+    /// Throws std::runtime_error, if the kernel does not support io_uring
+    /// or does not allow it.
+    explicit IoRing(unsigned entries);
+    ~IoRing();
+
+    /// Queue a read of up to `size` bytes from `offset` of a file.
+    /// \param user_data Returned with the completion of the request.
+    void read(int fd, void* buffer, unsigned size, uint64_t offset,
+              uint64_t user_data);
+    /// Queue a write of up to `size` bytes at `offset` of a file.
+    void write(int fd, void const* buffer, unsigned size, uint64_t offset,
+               uint64_t user_data);
+
+    /// Submit the queued requests to the kernel with a single system call.
+    /// \param wait The number of completions to wait for.
+    void submit(unsigned wait=0);
+
+    /// Take the next completion, if any.
+    /// \param user_data Set to the user data of the completed request.
+    /// \param result Set to the result of the request, the number of bytes
+    ///               transferred or a negated errno value.
+    /// \return false, if there are no completions.
+    bool complete(uint64_t& user_data, int& result);
+};
+
+} //namespace suflem
+
+#endif // IORING_HPP_INCLUDED
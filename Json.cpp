@@ -0,0 +1,178 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Json.hpp"
+
+#include <cstdio>
+
+namespace suflem {
+namespace json {
+
+// append code point `cp` to `out` in utf-8 encoding
+static void append_utf8(unsigned long cp, std::string& out) {
+    if (cp < 0x80) {
+        out.push_back(cp);
+    } else if (cp < 0x800) {
+        out.push_back(0xC0 | (cp >> 6));
+        out.push_back(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out.push_back(0xE0 | (cp >> 12));
+        out.push_back(0x80 | ((cp >> 6) & 0x3F));
+        out.push_back(0x80 | (cp & 0x3F));
+    } else {
+        out.push_back(0xF0 | (cp >> 18));
+        out.push_back(0x80 | ((cp >> 12) & 0x3F));
+        out.push_back(0x80 | ((cp >> 6) & 0x3F));
+        out.push_back(0x80 | (cp & 0x3F));
+    }
+}
+
+static unsigned long parse_hex4(char const*& p, char const* end)
+{
+    if (end - p < 4) {
+        throw std::runtime_error("Truncated \\u escape in JSON.");
+    }
+    unsigned long cp = 0;
+    for (int i=0 ; i<4 ; ++i, ++p) {
+        char c = *p;
+        cp <<= 4;
+        if (c >= '0' && c <= '9') {
+            cp |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            cp |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            cp |= c - 'A' + 10;
+        } else {
+            throw std::runtime_error("Invalid \\u escape in JSON.");
+        }
+    }
+    return cp;
+}
+
+void parse_string(char const*& p, char const* end, std::string& out)
+{
+    out.clear();
+    while (p < end && *p != '"') {
+        if (*p != '\\') {
+            out.push_back(*p++);
+            continue;
+        }
+        if (++p == end) {
+            break;
+        }
+        char c = *p++;
+        switch (c) {
+            case '"':  out.push_back('"');  break;
+            case '\\': out.push_back('\\'); break;
+            case '/':  out.push_back('/');  break;
+            case 'b':  out.push_back('\b'); break;
+            case 'f':  out.push_back('\f'); break;
+            case 'n':  out.push_back('\n'); break;
+            case 'r':  out.push_back('\r'); break;
+            case 't':  out.push_back('\t'); break;
+            case 'u': {
+                unsigned long cp = parse_hex4(p, end);
+                // combine utf-16 surrogate pairs
+                if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 &&
+                    p[0] == '\\' && p[1] == 'u')
+                {
+                    p += 2;
+                    unsigned long low = parse_hex4(p, end);
+                    if (low < 0xDC00 || low >= 0xE000) {
+                        throw std::runtime_error("Invalid surrogate in JSON.");
+                    }
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+                append_utf8(cp, out);
+                break;
+            }
+            default:
+                throw std::runtime_error("Invalid escape in JSON.");
+        }
+    }
+    if (p == end) {
+        throw std::runtime_error("Unterminated string in JSON.");
+    }
+    ++p; // closing quote
+}
+
+void skip_space(char const*& p, char const* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        ++p;
+    }
+}
+
+void skip_value(char const*& p, char const* end) {
+    // nesting is tracked by depth only, the brackets are not matched
+    // against each other, which is enough for skipping valid documents
+    long depth = 0;
+    std::string unused;
+    do {
+        skip_space(p, end);
+        if (p == end) {
+            throw std::runtime_error("Unexpected end of JSON.");
+        }
+        char c = *p++;
+        if (c == '"') {
+            parse_string(p, end, unused);
+        } else if (c == '{' || c == '[') {
+            ++depth;
+        } else if (c == '}' || c == ']') {
+            if (--depth < 0) {
+                throw std::runtime_error("Unexpected '" + std::string(1, c) +
+                                         "' in JSON.");
+            }
+        } else if (c == ',' || c == ':') {
+            if (depth == 0) {
+                throw std::runtime_error("Expected a value in JSON.");
+            }
+        } else {
+            // numbers, true, false and null
+            while (p < end && *p != ',' && *p != ':' && *p != '}' &&
+                   *p != ']' && *p != ' ' && *p != '\t' && *p != '\n' &&
+                   *p != '\r')
+            {
+                ++p;
+            }
+        }
+    } while (depth > 0);
+}
+
+void append_string(std::string const& s, std::string& out) {
+    out.push_back('"');
+    for (size_t i=0 ; i<s.size() ; ++i) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else if (c == '\n') {
+            out.append("\\n");
+        } else if (c == '\t') {
+            out.append("\\t");
+        } else if (c < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out.append(escape);
+        } else {
+            out.push_back(c);
+        }
+    }
+    out.push_back('"');
+}
+
+} // namespace json
+} // namespace suflem
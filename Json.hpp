@@ -0,0 +1,48 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef JSON_HPP_INCLUDED
+#define JSON_HPP_INCLUDED
+
+#include <string>
+#include <stdexcept>
+
+namespace suflem {
+
+/// Minimal JSON scanning, enough to pick strings out of a document without
+/// building a tree. Malformed input throws std::runtime_error.
+namespace json {
+
+/// Skip JSON whitespace.
+void skip_space(char const*& p, char const* end);
+
+/// Parse a string starting after the opening quote.
+/// Escapes are decoded and surrogate pairs combined, `p` is left after the
+/// closing quote.
+/// \param out Set to the utf-8 encoded string.
+void parse_string(char const*& p, char const* end, std::string& out);
+
+/// Skip a value of any type, including nested objects and arrays.
+/// `p` must point to the first character of the value.
+void skip_value(char const*& p, char const* end);
+
+/// Append `s` to `out` as a quoted and escaped JSON string.
+void append_string(std::string const& s, std::string& out);
+
+} // namespace json
+} // namespace suflem
+
+#endif // JSON_HPP_INCLUDED
@@ -16,8 +16,11 @@
 */
 
 #include "Model.hpp"
+#include "Utf8.hpp"
 
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <vector>
 #include <algorithm>
 
@@ -29,58 +32,63 @@ long const MAX_LINE_LENGTH = 1024;
 // Miscellaneous functions
 ///////////////////////////////////////////////////////////////////////////////
 
-// function for detecting utf-8 codepoint begins in string `s`.
-// the indices in `s` are stored into `v`.
-static inline bool store_codepoints(std::string const& s,
-                                    std::vector<long>& v) {
-    const long masks[] = {0, 0x6, 0xE, 0x1E, 0x3E, 0x7E};
-    const long shift[] = {7, 5, 4, 3, 2, 1};
-    const long n = static_cast<long>(s.size());
-    v.clear();
-    for (long i=0 ; i<n ; ++i) {
-        bool found_start = false;
-        unsigned char c = static_cast<unsigned char>(s[i]);
-        for (int j=0 ; j<6 ; ++j) {
-            if (c >> shift[j] == masks[j]) { // we detect a code point
-                v.push_back(i);
-                found_start = true;
-                break;
-            }
-        }
-        if (!found_start) {
-            if (c >> 6 != 0x2 || i == 0) {
-                // utf-8 decode error
-                return false;
-            }
-        }
-    }
-    return true;
+// simple function for computing probability of tp and fp counts
+static inline double compute_prob(std::pair<long, long> const& p) {
+    return static_cast<double>(p.first) / (p.first + p.second);
 }
 
-static inline
-long common_prefix_size(std::string const& a, std::string const& b,
-                        std::vector<long> const& acodepoints,
-                        std::vector<long> const& bcodepoints)
-{
-    long N = std::min(acodepoints.size(), bcodepoints.size());
-    long preflen = 0;
-    for (long j=0 ; j<N ; ++j) {
-        if (acodepoints[j] != bcodepoints[j]) {
-            return j;
-        }
-        for (long i=preflen ; i<acodepoints[j] ; ++i) {
-            if (a[i] != b[i]) {
-                return j;
-            }
-        }
-        preflen = acodepoints[j];
+// 64-bit FNV-1a hash of `size` bytes of `data`, continuing from `h`.
+static inline uint64_t fnv1a(void const* data, size_t size,
+                             uint64_t h=14695981039346656037ULL) {
+    unsigned char const* p = static_cast<unsigned char const*>(data);
+    for (size_t i=0 ; i<size ; ++i) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
     }
-    return N;
+    return h;
 }
 
-// simple function for computing probability of tp and fp counts
-static inline double compute_prob(std::pair<long, long> const& p) {
-    return static_cast<double>(p.first) / (p.first + p.second);
+// hash of a single model table entry. the strings are hashed including
+// their terminating zero, so that ("ab", "c") and ("a", "bc") differ.
+static inline uint64_t entry_hash(int table, std::string const& a,
+                                  std::string const& b,
+                                  std::pair<long, long> const& p) {
+    uint64_t h = fnv1a(&table, sizeof(table));
+    h = fnv1a(a.c_str(), a.size()+1, h);
+    h = fnv1a(b.c_str(), b.size()+1, h);
+    h = fnv1a(&p.first, sizeof(p.first), h);
+    h = fnv1a(&p.second, sizeof(p.second), h);
+    // final avalanche, so that summing the entries mixes well
+    h ^= h >> 33; h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// estimated heap memory of a string, short strings are stored inline
+static inline size_t string_memory(std::string const& s) {
+    return s.capacity() > 15 ? s.capacity() + 1 : 0;
+}
+
+// estimated heap memory of a hash table, not including the heap memory of
+// its keys and values. every node holds a next pointer and the cached hash.
+template <typename Map>
+static inline size_t table_memory(Map const& m) {
+    return m.bucket_count() * sizeof(void*) +
+           m.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void*));
+}
+
+// shard of a suffix, chosen by a hash of its last utf-8 code point.
+// returns num_shards for the empty suffix, which every shard needs.
+static inline size_t suffix_shard(std::string const& s, size_t num_shards) {
+    if (s.size() == 0) {
+        return num_shards;
+    }
+    size_t begin = s.size() - 1;
+    while (begin > 0 && (static_cast<unsigned char>(s[begin]) >> 6) == 0x2) {
+        --begin;
+    }
+    return fnv1a(s.data() + begin, s.size() - begin) % num_shards;
 }
 
 // trim from start
@@ -107,7 +115,7 @@ static inline std::string &trim(std::string &s) {
 // Main model methods
 ///////////////////////////////////////////////////////////////////////////////
 
-Model::Model(size_t max_suffix_size) throw(std::runtime_error) :
+Model::Model(size_t max_suffix_size) :
     _replacements(), _lemcounts(), _infcounts(),
     _max_suffix_size(max_suffix_size), _is_trimmed(false)
 {
@@ -138,12 +146,26 @@ void Model::update_lemma(std::string const& lem, long tp, long fp) {
     data.second += fp;
 }
 
-void Model::update(std::string const& inflected, std::string const& lemma,
-                   long count) throw(std::runtime_error)
+long Model::update(std::string const& inflected, std::string const& lemma,
+                   long count)
 {
     if (is_trimmed()) {
         throw std::runtime_error("Cannot update a trimmed model.");
     }
+    return add_example(inflected, lemma, count);
+}
+
+void Model::feedback(std::string const& inflected, std::string const& lemma,
+                     long count)
+{
+    add_example(inflected, lemma, count);
+    _is_trimmed = false;
+}
+
+long Model::add_example(std::string const& inflected,
+                        std::string const& lemma,
+                        long count)
+{
     // insert special markers to denote string beginning
     std::string inf = '$' + inflected;
     std::string lem = '$' + lemma;
@@ -190,77 +212,163 @@ void Model::update(std::string const& inflected, std::string const& lemma,
         update_inflected(lemsuf, 0, count);
         //printf("%ld\t%s\t%s\n", i, infsuf.c_str(), lemsuf.c_str());
     }
+    return std::max(n - 1 - m, 0L);
 }
 
-std::string Model::lemmatize(std::string const& inflected)
-    const throw(std::runtime_error)
+bool Model::best_replacement(std::string const& infsuf,
+                             std::string& lemsuf) const
 {
-    std::string inf = '$' + inflected; inf = suflem::trim(inf);
-    std::string infsuf;
-    std::string lemsuf;
-    std::string best_lemma;
-    std::vector<long> codepoints;
-    double best_prob;
-    bool iter_found;
+    double best_prob = 0.0;
+    bool found = false;
     double prAB, prBA, prA, prB;
 
-    if (!store_codepoints(inf, codepoints)) {
-        throw std::runtime_error("Utf-8 decode error!");
+    // get the probability of inflected suffix
+    auto infit = _infcounts.find(infsuf);
+    if (infit != _infcounts.end()) {
+        prB = compute_prob(infit->second);
+    } else {
+        // probability is zero
+        return false;
     }
-    codepoints.push_back(inf.size());
-    long n = codepoints.size();
 
-    // start looking for longest suffix replacements
-    for (long i=0 ; i<n ; ++i) {
-        best_prob  = 0.0;
-        iter_found = false;
-        // get the probability of inflected suffix
-        infsuf = inf.substr(codepoints[i]);
-        auto infit = _infcounts.find(infsuf);
-        if (infit != _infcounts.end()) {
-            prB = compute_prob(infit->second);
-        } else {
-            // probability is zero
+    // does this infsuf has possible replacements
+    auto repit = _replacements.find(infsuf);
+    if (repit == _replacements.end()) {
+        return false;
+    }
+
+    // check out different replacements
+    for (auto k=repit->second.begin() ; k != repit->second.end() ; ++k) {
+        // get lemma suffix probability
+        auto lemit = _lemcounts.find(k->first);
+        if (lemit == _lemcounts.end()) {
+            // probability will be zero
             continue;
+        } else {
+            prA = compute_prob(lemit->second);
+        }
+        // get replacement probability
+        prBA = compute_prob(k->second);
+        // compute the probability, that lemsuf is the correct replacement
+        // for infsuf
+        prAB = (prBA * prA) / prB;
+        // equally probable replacements are ordered by the lemma suffix,
+        // as the iteration order of the map differs between copies of the
+        // same model
+        if (prAB > best_prob ||
+                (found && prAB == best_prob && k->first < lemsuf)) {
+            lemsuf = k->first;
+            best_prob = prAB;
+            found = true;
         }
+    }
+    return found;
+}
 
-        // does this infsuf has possible replacements
-        auto repit = _replacements.find(infsuf);
-        if (repit == _replacements.end()) {
+Model Model::shard(size_t index, size_t num_shards) const {
+    Model model(_max_suffix_size);
+    model._is_trimmed = _is_trimmed;
+    for (auto i=_infcounts.begin() ; i!=_infcounts.end() ; ++i) {
+        size_t s = suffix_shard(i->first, num_shards);
+        if (s == index || s == num_shards) {
+            model._infcounts.insert(*i);
+        }
+    }
+    for (auto i=_replacements.begin() ; i!=_replacements.end() ; ++i) {
+        size_t s = suffix_shard(i->first, num_shards);
+        if (s != index && s != num_shards) {
             continue;
         }
-
-        // check out different replacements
-        for (auto k=repit->second.begin() ; k != repit->second.end() ; ++k) {
-            lemsuf = k->first;
-            // get lemma suffix probability
-            auto lemit = _lemcounts.find(lemsuf);
-            if (lemit == _lemcounts.end()) {
-                // probability will be zero
-                continue;
-            } else {
-                prA = compute_prob(lemit->second);
-            }
-            // get replacement probability
-            prBA = compute_prob(k->second);
-            // compute the probability, that lemsuf is the correct replacement
-            // for infsuf
-            prAB = (prBA * prA) / prB;
-            //printf("%s %lf=(%lf * %lf)/%lf\n", (inf.substr(0, codepoints[i]) + lemsuf).c_str(), prAB, prBA, prA, prB);
-            if (prAB > best_prob) {
-                best_lemma = inf.substr(0, codepoints[i]) + lemsuf;
-                best_prob = prAB;
-                iter_found = true;
+        model._replacements.insert(*i);
+        // lemma suffixes are needed only as replacements of shard suffixes
+        for (auto j=i->second.begin() ; j!=i->second.end() ; ++j) {
+            auto lemit = _lemcounts.find(j->first);
+            if (lemit != _lemcounts.end()) {
+                model._lemcounts.insert(*lemit);
             }
         }
+    }
+    return model;
+}
+
+size_t Model::shard_of(std::string const& inflected, size_t num_shards) {
+    // the words are lemmatized with the same preprocessing
+    std::string inf = '$' + inflected; inf = suflem::trim(inf);
+    return suffix_shard(inf, num_shards);
+}
 
-        // did we find anything?
-        if (iter_found) {
-            return best_lemma.substr(1); // trim the $ from beginning
+std::vector<std::string> Model::inflected_suffixes() const {
+    std::vector<std::string> suffixes;
+    suffixes.reserve(_replacements.size());
+    for (auto i=_replacements.begin() ; i!=_replacements.end() ; ++i) {
+        suffixes.push_back(i->first);
+    }
+    return suffixes;
+}
+
+Model::Status Model::lemmatize_word(std::string const& inflected,
+                                    std::string& lemma,
+                                    std::string& inf,
+                                    std::string& suffix,
+                                    std::vector<long>& codepoints) const
+{
+    inf.assign(1, '$').append(inflected); suflem::trim(inf);
+    if (!store_codepoints(inf, codepoints)) {
+        lemma = inflected;
+        return INVALID;
+    }
+    codepoints.push_back(inf.size());
+    long n = codepoints.size();
+
+    // start looking for longest suffix replacements
+    for (long i=0 ; i<n ; ++i) {
+        suffix.assign(inf, codepoints[i], std::string::npos);
+        if (best_replacement(suffix, lemma)) {
+            // prepend the unchanged prefix without the $ from beginning
+            if (codepoints[i] == 0) {
+                lemma.erase(0, 1);
+            } else {
+                lemma.insert(0, inf, 1, codepoints[i] - 1);
+            }
+            return LEMMATIZED;
         }
     }
     // did not find anything
-    return inflected;
+    lemma = inflected;
+    return UNCHANGED;
+}
+
+std::string Model::lemmatize(std::string const& inflected) const
+{
+    std::string lemma;
+    std::string inf;
+    std::string suffix;
+    std::vector<long> codepoints;
+    if (lemmatize_word(inflected, lemma, inf, suffix, codepoints) == INVALID) {
+        throw std::runtime_error("Utf-8 decode error!");
+    }
+    return lemma;
+}
+
+Model::Status Model::lemmatize(std::string const& inflected,
+                               std::string& lemma) const noexcept
+{
+    std::string inf;
+    std::string suffix;
+    std::vector<long> codepoints;
+    return lemmatize_word(inflected, lemma, inf, suffix, codepoints);
+}
+
+void Model::lemmatize(std::vector<std::string> const& words,
+                      std::vector<std::string>& lemmas) const
+{
+    std::string inf;
+    std::string suffix;
+    std::vector<long> codepoints;
+    lemmas.resize(words.size());
+    for (size_t i=0 ; i<words.size() ; ++i) {
+        lemmatize_word(words[i], lemmas[i], inf, suffix, codepoints);
+    }
 }
 
 void Model::trim() {
@@ -316,13 +424,63 @@ void Model::trim() {
     //printf("%ld %ld %ld\n", numlem, numinf, numrep);
 }
 
+size_t Model::memory_usage() const {
+    size_t bytes = table_memory(_lemcounts) + table_memory(_infcounts) +
+                   table_memory(_replacements);
+    for (auto i=_lemcounts.begin() ; i!=_lemcounts.end() ; ++i) {
+        bytes += string_memory(i->first);
+    }
+    for (auto i=_infcounts.begin() ; i!=_infcounts.end() ; ++i) {
+        bytes += string_memory(i->first);
+    }
+    for (auto i=_replacements.begin() ; i!=_replacements.end() ; ++i) {
+        bytes += string_memory(i->first) + table_memory(i->second);
+        for (auto j=i->second.begin() ; j!=i->second.end() ; ++j) {
+            bytes += string_memory(j->first);
+        }
+    }
+    return bytes;
+}
+
+Model::TableSizes Model::table_sizes() const {
+    TableSizes sizes;
+    sizes.lemma_suffixes = _lemcounts.size();
+    sizes.inflected_suffixes = _infcounts.size();
+    sizes.replaced_suffixes = _replacements.size();
+    for (auto i=_replacements.begin() ; i!=_replacements.end() ; ++i) {
+        sizes.replacements += i->second.size();
+    }
+    return sizes;
+}
+
+uint64_t Model::fingerprint() const {
+    static std::string const empty;
+    // entry hashes are summed, which makes the result independent of
+    // the iteration order of the hash tables
+    uint64_t h = entry_hash(0, empty, empty,
+                            std::make_pair(static_cast<long>(_max_suffix_size),
+                                           static_cast<long>(_is_trimmed)));
+    for (auto i=_lemcounts.begin() ; i!=_lemcounts.end() ; ++i) {
+        h += entry_hash(1, i->first, empty, i->second);
+    }
+    for (auto i=_infcounts.begin() ; i!=_infcounts.end() ; ++i) {
+        h += entry_hash(2, i->first, empty, i->second);
+    }
+    for (auto i=_replacements.begin() ; i!=_replacements.end() ; ++i) {
+        for (auto j=i->second.begin() ; j!=i->second.end() ; ++j) {
+            h += entry_hash(3, i->first, j->first, j->second);
+        }
+    }
+    return h;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Other model related methods.
 ///////////////////////////////////////////////////////////////////////////////
 
 Model Model::train(std::string const& filename,
-                          long const max_suffix_size)
-    throw(std::runtime_error)
+                   long const max_suffix_size,
+                   TrainingStats* stats)
 {
     FILE* fin = fopen(filename.c_str(), "rb");
     if (!fin) {
@@ -330,33 +488,52 @@ Model Model::train(std::string const& filename,
         throw std::runtime_error(err);
     }
     Model model(max_suffix_size);
+    TrainingStats counts;
 
     char lemma[MAX_LINE_LENGTH+32];
     char inflected[MAX_LINE_LENGTH+32];
     long count;
     long lineno = 0;
+    char* line = 0;
+    size_t capacity = 0;
 
-    while (fscanf(fin, "%1024[^\t]\t%1024[^\t]\t%ld%*[\n]", 
-            inflected, lemma, &count) == 3)
-    {
-        std::string inf = inflected;
-        std::string lem = lemma;
-        inf = suflem::trim(inf); lem = suflem::trim(lem);
-        if (inf.size() == 0 || lem.size() == 0) {
-            fclose(fin);
-            std::string err = "Zero-length string on line "
-                + std::to_string(lineno);
-            throw std::runtime_error(err);
+    while (getline(&line, &capacity, fin) >= 0) {
+        ++lineno;
+        std::string error;
+        if (line[strspn(line, " \t\r\n")] == '\0') {
+            // skip empty lines
+            continue;
+        } else if (sscanf(line, "%1024[^\t]\t%1024[^\t]\t%ld",
+                          inflected, lemma, &count) != 3) {
+            error = "Malformed line ";
+        } else {
+            std::string inf = inflected;
+            std::string lem = lemma;
+            inf = suflem::trim(inf); lem = suflem::trim(lem);
+            if (inf.size() == 0 || lem.size() == 0) {
+                error = "Zero-length string on line ";
+            } else if (count <= 0) {
+                error = "count<=0 on line ";
+            } else {
+                try {
+                    counts.updates += model.update(inf, lem, count);
+                    ++counts.lines;
+                } catch (std::exception& e) {
+                    error = std::string(e.what()) + " on line ";
+                }
+            }
         }
-        if (count <= 0) {
+        if (error.size() == 0) {
+            continue;
+        }
+        if (!stats) {
+            free(line);
             fclose(fin);
-            std::string err = "count<=0 on line "
-                + std::to_string(lineno);
-            throw std::runtime_error(err);
+            throw std::runtime_error(error + std::to_string(lineno));
         }
-        model.update(inf, lem, count);
-        ++lineno;
+        ++counts.skipped;
     }
+    free(line);
     if (!feof(fin)) {
         fclose(fin);
         throw std::runtime_error("Read error after line "
@@ -364,10 +541,13 @@ Model Model::train(std::string const& filename,
     }
 
     fclose(fin);
+    if (stats) {
+        *stats = counts;
+    }
     return model;
 }
 
-Model Model::load(std::string const& filename) throw(std::runtime_error) {
+Model Model::load(std::string const& filename) {
     // open the file for loading and initiate a reader
     FILE* fin = fopen(filename.c_str(), "rb");
     if (!fin) {
@@ -456,7 +636,6 @@ Model Model::load(std::string const& filename) throw(std::runtime_error) {
 }
 
 void Model::save(Model const& model, std::string const& filename)
-    throw(std::runtime_error)
 {
     FILE* fout = fopen(filename.c_str(), "wb");
     if (!fout) {
@@ -17,7 +17,9 @@
 #ifndef MODEL_HPP_INCLUDED
 #define MODEL_HPP_INCLUDED
 
+#include <cstdint>
 #include <string>
+#include <vector>
 #include <unordered_map>
 #include <exception>
 #include <stdexcept>
@@ -26,6 +28,35 @@ namespace suflem {
 
 /// Statistical suffix replacement model class.
 class Model {
+public:
+    /// Outcome of lemmatizing a word.
+    enum Status {
+        LEMMATIZED,  ///< a suffix replacement was applied
+        UNCHANGED,   ///< no replacement found, the lemma is the word itself
+        INVALID      ///< the word is not valid utf-8 and was passed through
+    };
+
+    /// Counts of a training run.
+    struct TrainingStats {
+        long lines;    ///< number of examples used
+        long skipped;  ///< number of malformed lines skipped
+        long updates;  ///< number of suffix pairs counted
+
+        TrainingStats() : lines(0), skipped(0), updates(0) {}
+    };
+
+    /// Numbers of entries in the tables of a model.
+    struct TableSizes {
+        long lemma_suffixes;      ///< lemma suffix counts
+        long inflected_suffixes;  ///< inflected suffix counts
+        long replaced_suffixes;   ///< inflected suffixes with replacements
+        long replacements;        ///< replacement counts of all suffixes
+
+        TableSizes() : lemma_suffixes(0), inflected_suffixes(0),
+                       replaced_suffixes(0), replacements(0) {}
+    };
+
+private:
     std::unordered_map<std::string,
                        std::unordered_map<std::string,
                                           std::pair<long, long>>> _replacements;
@@ -41,18 +72,79 @@ protected:
                             long fp);
     void update_inflected(std::string const& inf, long tp, long fp);
     void update_lemma(std::string const& lem, long tp, long fp);
-    void update(std::string const& inflected,
+    long update(std::string const& inflected,
                 std::string const& lemma,
-                long count) throw(std::runtime_error);
+                long count);
+    long add_example(std::string const& inflected,
+                     std::string const& lemma,
+                     long count);
+
+    Model(size_t max_suffix_size=8);
 
-    Model(size_t max_suffix_size=8) throw(std::runtime_error);
+    Status lemmatize_word(std::string const& inflected,
+                          std::string& lemma,
+                          std::string& inf,
+                          std::string& suffix,
+                          std::vector<long>& codepoints) const;
 
 public:
     /// Lemmatize a word.
     /// \param inflected The inflected form of a word.
     /// \return lemmatized form of the word.
-    std::string lemmatize(std::string const& inflected)
-        const throw(std::runtime_error);
+    std::string lemmatize(std::string const& inflected) const;
+
+    /// Lemmatize a word without throwing exceptions.
+    /// Meant for dirty input, where invalid words are common and should be
+    /// passed through instead of stopping the processing.
+    /// \param inflected The inflected form of a word.
+    /// \param lemma Set to the lemma, or to the word itself, if it is not
+    ///              valid utf-8.
+    /// \return The outcome for the word.
+    Status lemmatize(std::string const& inflected,
+                     std::string& lemma) const noexcept;
+
+    /// Lemmatize a batch of words.
+    /// Faster than lemmatizing the words one by one, as the buffers are
+    /// reused between the words. Words that are not valid utf-8 are
+    /// returned unchanged.
+    /// \param words The inflected forms of the words.
+    /// \param lemmas Set to the lemmas of the words in the same order.
+    void lemmatize(std::vector<std::string> const& words,
+                   std::vector<std::string>& lemmas) const;
+
+    /// Find the most probable replacement for an inflected suffix.
+    /// Of equally probable replacements the smallest lemma suffix wins, so
+    /// copies of a model loaded from different files agree.
+    /// \param infsuf The inflected suffix, '$' denotes the word beginning.
+    /// \param lemsuf Set to the lemma suffix replacing `infsuf`, if found.
+    /// \return true, if the model has a replacement for the suffix.
+    bool best_replacement(std::string const& infsuf,
+                          std::string& lemsuf) const;
+
+    /// List inflected suffixes, that have replacements in the model.
+    std::vector<std::string> inflected_suffixes() const;
+
+    /// Extract the part of the model needed for one shard.
+    /// Words are assigned to shards by their final character, see shard_of().
+    /// A shard lemmatizes the words it owns exactly like the full model.
+    /// \param index The index of the shard, 0 <= index < num_shards.
+    /// \param num_shards The total number of shards.
+    Model shard(size_t index, size_t num_shards) const;
+
+    /// Index of the shard owning a word.
+    static size_t shard_of(std::string const& inflected, size_t num_shards);
+
+    /// Apply a corrected example to the model.
+    /// Unlike training, feedback is also accepted by trimmed models. The
+    /// model is no longer trimmed afterwards, call trim() to drop the
+    /// suffixes the example added only as false positives.
+    /// A negative count takes back an earlier example.
+    /// \param inflected The inflected form of a word.
+    /// \param lemma The correct lemma of the word.
+    /// \param count The weight of the example.
+    void feedback(std::string const& inflected,
+                  std::string const& lemma,
+                  long count);
 
     /// Trim the model to reduce size.
     /// You won't be able to update() the model after trimming.
@@ -61,14 +153,28 @@ public:
     /// Is the model trimmed.
     bool is_trimmed() const { return _is_trimmed; }
 
+    /// Estimate the heap memory used by the model in bytes.
+    size_t memory_usage() const;
+
+    /// Count the entries in the tables of the model.
+    TableSizes table_sizes() const;
+
+    /// Compute a hash of the model contents.
+    /// Equal models have equal fingerprints regardless of the order in
+    /// which their tables were filled.
+    uint64_t fingerprint() const;
+
     /// Train the model from data set specified by filename.
-    static Model train(std::string const& filename, long const max_suffix_size)
-        throw(std::runtime_error);
+    /// \param stats If given, malformed lines are skipped and counted in
+    ///              `stats`. Otherwise the first malformed line stops the
+    ///              training with an exception.
+    static Model train(std::string const& filename,
+                       long const max_suffix_size,
+                       TrainingStats* stats=0);
     /// Load a previously trained model from file specified by filename.
-    static Model load(std::string const& filename) throw(std::runtime_error);
+    static Model load(std::string const& filename);
     /// Save a model to file specified by filename.
-    static void save(Model const& model, std::string const& filename)
-        throw(std::runtime_error);
+    static void save(Model const& model, std::string const& filename);
 };
 
 } //namespace suflem
@@ -0,0 +1,136 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PerfCounters.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace suflem {
+
+static char const* const EVENT_NAMES[PerfCounters::NUM_EVENTS] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses",
+    "dtlb_misses"
+};
+
+static uint64_t cache_event(uint64_t cache, uint64_t op, uint64_t result) {
+    return cache | (op << 8) | (result << 16);
+}
+
+// open a counter of the calling thread on any cpu
+static int open_counter(uint32_t type, uint64_t config) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+PerfCounters::PerfCounters() {
+    static uint32_t const types[NUM_EVENTS] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE
+    };
+    static uint64_t const configs[NUM_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                    PERF_COUNT_HW_CACHE_RESULT_MISS),
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+                    PERF_COUNT_HW_CACHE_RESULT_MISS)
+    };
+    // the counters are opened one by one rather than as a group, so that
+    // a missing one does not take the others with it
+    for (int i=0 ; i<NUM_EVENTS ; ++i) {
+        _fds[i] = open_counter(types[i], configs[i]);
+        _values[i] = -1;
+        if (_fds[i] < 0 && _error.size() == 0) {
+            _error = std::string(EVENT_NAMES[i]) + ": " + strerror(errno);
+        }
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    for (int i=0 ; i<NUM_EVENTS ; ++i) {
+        if (_fds[i] >= 0) {
+            close(_fds[i]);
+        }
+    }
+}
+
+bool PerfCounters::available() const {
+    for (int i=0 ; i<NUM_EVENTS ; ++i) {
+        if (_fds[i] >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PerfCounters::start() {
+    for (int i=0 ; i<NUM_EVENTS ; ++i) {
+        if (_fds[i] >= 0) {
+            ioctl(_fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void PerfCounters::stop() {
+    for (int i=0 ; i<NUM_EVENTS ; ++i) {
+        if (_fds[i] >= 0) {
+            ioctl(_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    for (int i=0 ; i<NUM_EVENTS ; ++i) {
+        _values[i] = -1;
+        // value, time enabled and time running
+        uint64_t data[3];
+        if (_fds[i] < 0 || ::read(_fds[i], data, sizeof(data)) !=
+                           static_cast<ssize_t>(sizeof(data)))
+        {
+            continue;
+        }
+        if (data[2] == 0) {
+            // never scheduled on the hardware
+            continue;
+        }
+        _values[i] = data[2] < data[1] ?
+            static_cast<long long>(static_cast<double>(data[0]) *
+                                   data[1] / data[2]) : data[0];
+    }
+}
+
+char const* PerfCounters::name(Event event) {
+    return EVENT_NAMES[event];
+}
+
+} // namespace suflem
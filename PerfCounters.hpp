@@ -0,0 +1,75 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef PERFCOUNTERS_HPP_INCLUDED
+#define PERFCOUNTERS_HPP_INCLUDED
+
+#include <string>
+
+namespace suflem {
+
+/// Hardware performance counters of the calling thread.
+/// Counts user space events through perf_event_open, which is allowed for
+/// the own process at the default perf_event_paranoid level of 2. Counters
+/// the kernel or the hardware does not provide, for example in most virtual
+/// machines, are left out instead of failing.
+class PerfCounters {
+public:
+    enum Event {
+        CYCLES,
+        INSTRUCTIONS,
+        L1D_MISSES,     ///< level 1 data cache read misses
+        LLC_MISSES,     ///< last level cache misses
+        BRANCH_MISSES,
+        DTLB_MISSES,    ///< data TLB read misses
+        NUM_EVENTS
+    };
+
+private:
+    int _fds[NUM_EVENTS];
+    long long _values[NUM_EVENTS];
+    std::string _error;
+
+    PerfCounters(PerfCounters const&);
+    PerfCounters& operator=(PerfCounters const&);
+
+public:
+    /// Open the counters, they do not count until start().
+    PerfCounters();
+    ~PerfCounters();
+
+    /// Is any of the counters available.
+    bool available() const;
+    /// Why the first unavailable counter could not be opened.
+    std::string const& error() const { return _error; }
+
+    /// Zero the counters and start counting.
+    void start();
+    /// Stop counting and read the counters.
+    void stop();
+
+    /// Count of an event between the last start() and stop(), scaled up
+    /// if the kernel had to share the hardware counters with others.
+    /// \return -1, if the counter is not available.
+    long long value(Event event) const { return _values[event]; }
+
+    /// Name of an event, as used in the reports.
+    static char const* name(Event event);
+};
+
+} //namespace suflem
+
+#endif // PERFCOUNTERS_HPP_INCLUDED
@@ -0,0 +1,156 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Protocol.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <arpa/inet.h>
+
+namespace suflem {
+namespace protocol {
+
+static inline void append_uint32(uint32_t value, std::string& out) {
+    value = htonl(value);
+    out.append(reinterpret_cast<char const*>(&value), sizeof(value));
+}
+
+static inline uint32_t read_uint32(char const* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return ntohl(value);
+}
+
+void append_frame(std::vector<std::string> const& words, std::string& out) {
+    append_frame(words.begin(), words.end(), out);
+}
+
+void append_frame(std::vector<std::string>::const_iterator begin,
+                  std::vector<std::string>::const_iterator end,
+                  std::string& out)
+{
+    size_t payload = sizeof(uint32_t);
+    for (auto i=begin ; i!=end ; ++i) {
+        payload += sizeof(uint32_t) + i->size();
+    }
+    // the peer would reject the frame
+    if (payload > MAX_FRAME_SIZE) {
+        throw std::runtime_error("Frame exceeds the maximum frame size.");
+    }
+    out.reserve(out.size() + HEADER_SIZE + payload);
+    append_uint32(payload, out);
+    append_uint32(end - begin, out);
+    for (auto i=begin ; i!=end ; ++i) {
+        append_uint32(i->size(), out);
+        out.append(*i);
+    }
+}
+
+size_t parse_frame(char const* data, size_t size,
+                   std::vector<std::string>& words)
+{
+    if (size < HEADER_SIZE) {
+        return 0;
+    }
+    uint32_t const payload = read_uint32(data);
+    if (payload > MAX_FRAME_SIZE || payload < sizeof(uint32_t)) {
+        throw std::runtime_error("Invalid frame size.");
+    }
+    if (size - HEADER_SIZE < payload) {
+        return 0;
+    }
+    char const* p = data + HEADER_SIZE;
+    char const* end = p + payload;
+    uint32_t const count = read_uint32(p);
+    p += sizeof(uint32_t);
+    // every word needs at least its length field
+    if (count > (payload - sizeof(uint32_t)) / sizeof(uint32_t)) {
+        throw std::runtime_error("Invalid word count in frame.");
+    }
+    words.resize(count);
+    for (uint32_t i=0 ; i<count ; ++i) {
+        if (end - p < static_cast<long>(sizeof(uint32_t))) {
+            throw std::runtime_error("Truncated frame.");
+        }
+        uint32_t const length = read_uint32(p);
+        p += sizeof(uint32_t);
+        if (static_cast<uint32_t>(end - p) < length) {
+            throw std::runtime_error("Truncated frame.");
+        }
+        words[i].assign(p, length);
+        p += length;
+    }
+    if (p != end) {
+        throw std::runtime_error("Trailing data in frame.");
+    }
+    return HEADER_SIZE + payload;
+}
+
+void FrameWriter::write(std::vector<std::string> const& words) {
+    // the fields are stored before pointing to them, so that they are not
+    // moved by a reallocation afterwards
+    _fields.resize(2 + words.size());
+    size_t payload = sizeof(uint32_t);
+    for (size_t i=0 ; i<words.size() ; ++i) {
+        _fields[2+i] = htonl(words[i].size());
+        payload += sizeof(uint32_t) + words[i].size();
+    }
+    if (payload > MAX_FRAME_SIZE) {
+        throw std::runtime_error("Frame exceeds the maximum frame size.");
+    }
+    _fields[0] = htonl(payload);
+    _fields[1] = htonl(words.size());
+
+    _iov.clear();
+    _iov.push_back(iovec{&_fields[0], 2 * sizeof(uint32_t)});
+    for (size_t i=0 ; i<words.size() ; ++i) {
+        _iov.push_back(iovec{&_fields[2+i], sizeof(uint32_t)});
+        if (words[i].size() > 0) {
+            _iov.push_back(iovec{const_cast<char*>(words[i].data()),
+                                 words[i].size()});
+        }
+    }
+
+    size_t done = 0;
+    while (done < _iov.size()) {
+        int count = std::min<size_t>(_iov.size() - done, IOV_MAX);
+        ssize_t w = writev(_fd, &_iov[done], count);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("Could not write frame: ")
+                                     + strerror(errno));
+        }
+        // skip the written pieces and adjust a partially written one
+        size_t written = w;
+        while (done < _iov.size() && written >= _iov[done].iov_len) {
+            written -= _iov[done].iov_len;
+            ++done;
+        }
+        if (written > 0) {
+            _iov[done].iov_base = static_cast<char*>(_iov[done].iov_base)
+                                  + written;
+            _iov[done].iov_len -= written;
+        }
+    }
+}
+
+} // namespace protocol
+} // namespace suflem
@@ -0,0 +1,81 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef PROTOCOL_HPP_INCLUDED
+#define PROTOCOL_HPP_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <sys/uio.h>
+
+namespace suflem {
+
+/// Length prefixed batch encoding used between suflem clients and servers.
+/// A frame is a 32-bit payload length followed by the payload. The payload
+/// is a 32-bit number of words, followed by each word as a 32-bit length
+/// and the bytes of the word. All integers are in network byte order.
+/// Requests carry inflected words, responses the lemmas in the same order.
+namespace protocol {
+
+/// Maximum accepted payload size of a frame.
+uint32_t const MAX_FRAME_SIZE = 64 << 20;
+
+/// Size of the frame header preceding the payload.
+size_t const HEADER_SIZE = 4;
+
+/// Append a frame holding `words` to `out`.
+/// Throws, if the payload would exceed MAX_FRAME_SIZE.
+void append_frame(std::vector<std::string> const& words, std::string& out);
+/// Append a frame holding the words in range [begin, end) to `out`.
+void append_frame(std::vector<std::string>::const_iterator begin,
+                  std::vector<std::string>::const_iterator end,
+                  std::string& out);
+
+/// Decode a frame from the beginning of a buffer.
+/// \param data The buffer.
+/// \param size The number of bytes in the buffer.
+/// \param words Set to the words of the frame, if it is complete.
+/// \return The size of the decoded frame or 0, if the buffer does not
+///         contain a complete frame yet.
+size_t parse_frame(char const* data, size_t size,
+                   std::vector<std::string>& words);
+
+/// Writes frames to a file descriptor with vectored I/O.
+/// The words are passed to the kernel where they are, instead of being
+/// copied into a frame buffer first.
+class FrameWriter {
+    int _fd;
+    std::vector<uint32_t> _fields;  // payload length, count, word lengths
+    std::vector<iovec> _iov;
+
+    FrameWriter(FrameWriter const&);
+    FrameWriter& operator=(FrameWriter const&);
+
+public:
+    /// \param fd The file descriptor to write, standard output by default.
+    explicit FrameWriter(int fd=1) : _fd(fd) {}
+
+    /// Write a frame holding `words`, blocking until it is written.
+    void write(std::vector<std::string> const& words);
+};
+
+} // namespace protocol
+} // namespace suflem
+
+#endif // PROTOCOL_HPP_INCLUDED
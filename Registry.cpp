@@ -0,0 +1,172 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Registry.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+#include <dirent.h>
+
+namespace suflem {
+
+static std::string const MODEL_EXTENSION = ".model";
+
+ModelRegistry::ModelRegistry(size_t memory_budget) :
+    _budget(memory_budget), _memory(0)
+{ }
+
+void ModelRegistry::add(std::string const& language,
+                        std::string const& filename)
+{
+    Snapshot old;   // released after unlocking
+    std::lock_guard<std::mutex> lock(_mutex);
+    Entry& entry = _entries[language];
+    if (entry.model) {
+        old = unload(entry);
+    }
+    entry.path = filename;
+    entry.memory = 0;
+    entry.load_mutex = std::make_shared<std::mutex>();
+}
+
+long ModelRegistry::add_directory(std::string const& dirname)
+{
+    DIR* dir = opendir(dirname.c_str());
+    if (!dir) {
+        throw std::runtime_error("Could not open directory " + dirname);
+    }
+    long count = 0;
+    while (dirent* e = readdir(dir)) {
+        std::string name = e->d_name;
+        if (name.size() <= MODEL_EXTENSION.size() ||
+            name.compare(name.size() - MODEL_EXTENSION.size(),
+                         MODEL_EXTENSION.size(), MODEL_EXTENSION) != 0)
+        {
+            continue;
+        }
+        add(name.substr(0, name.size() - MODEL_EXTENSION.size()),
+            dirname + "/" + name);
+        ++count;
+    }
+    closedir(dir);
+    return count;
+}
+
+ModelRegistry::Snapshot ModelRegistry::get(std::string const& language)
+{
+    std::shared_ptr<std::mutex> load_mutex;
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _entries.find(language);
+        if (it == _entries.end()) {
+            throw std::runtime_error("Unknown language " + language);
+        }
+        Entry& entry = it->second;
+        if (entry.model) {
+            _lru.splice(_lru.begin(), _lru, entry.lru);
+            return entry.model;
+        }
+        load_mutex = entry.load_mutex;
+        path = entry.path;
+    }
+
+    // load without holding the registry lock, so that other languages can
+    // be served meanwhile. the load mutex makes concurrent requests for the
+    // same language wait for a single load.
+    std::lock_guard<std::mutex> load_lock(*load_mutex);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Entry& entry = _entries[language];
+        if (entry.model) {
+            _lru.splice(_lru.begin(), _lru, entry.lru);
+            return entry.model;
+        }
+    }
+    fprintf(stderr, "Loading %s model from %s.\n",
+            language.c_str(), path.c_str());
+    Snapshot model = std::make_shared<Model>(Model::load(path));
+    size_t memory = model->memory_usage();
+
+    // evicted models are freed after unlocking, as freeing a large model
+    // would block the lookups of other languages
+    std::vector<Snapshot> evicted;
+    std::lock_guard<std::mutex> lock(_mutex);
+    Entry& entry = _entries[language];
+    entry.model = model;
+    entry.memory = memory;
+    _lru.push_front(language);
+    entry.lru = _lru.begin();
+    _memory += memory;
+    evict(language, evicted);
+    return model;
+}
+
+ModelRegistry::Snapshot ModelRegistry::unload(Entry& entry) {
+    _memory -= entry.memory;
+    _lru.erase(entry.lru);
+    entry.memory = 0;
+    return std::move(entry.model);
+}
+
+void ModelRegistry::evict(std::string const& keep,
+                          std::vector<Snapshot>& evicted)
+{
+    while (_budget > 0 && _memory > _budget && _lru.size() > 0) {
+        std::string language = _lru.back();
+        if (language == keep) {
+            // the model in use is never evicted, even if it alone
+            // exceeds the budget
+            break;
+        }
+        fprintf(stderr, "Unloading %s model.\n", language.c_str());
+        evicted.push_back(unload(_entries[language]));
+    }
+}
+
+void ModelRegistry::clear() {
+    std::vector<Snapshot> unloaded;   // released after unlocking
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto i=_entries.begin() ; i!=_entries.end() ; ++i) {
+        if (i->second.model) {
+            unloaded.push_back(unload(i->second));
+        }
+    }
+}
+
+size_t ModelRegistry::memory_usage() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _memory;
+}
+
+std::vector<std::string> ModelRegistry::languages() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<std::string> result;
+    for (auto i=_entries.begin() ; i!=_entries.end() ; ++i) {
+        result.push_back(i->first);
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+std::vector<std::string> ModelRegistry::loaded_languages() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return std::vector<std::string>(_lru.begin(), _lru.end());
+}
+
+} // namespace suflem
@@ -0,0 +1,87 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef REGISTRY_HPP_INCLUDED
+#define REGISTRY_HPP_INCLUDED
+
+#include "Model.hpp"
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+
+namespace suflem {
+
+/// Models of several languages, loaded on first use.
+/// When the estimated memory of the loaded models exceeds the budget, the
+/// least recently used models are unloaded. Requests still using an
+/// unloaded model keep it alive until they finish.
+class ModelRegistry {
+public:
+    typedef std::shared_ptr<Model const> Snapshot;
+
+private:
+    struct Entry {
+        std::string path;
+        Snapshot model;
+        size_t memory;
+        std::list<std::string>::iterator lru;
+        std::shared_ptr<std::mutex> load_mutex;
+    };
+
+    size_t _budget;
+    size_t _memory;
+    std::unordered_map<std::string, Entry> _entries;
+    std::list<std::string> _lru;  // loaded languages, most recent first
+    mutable std::mutex _mutex;
+
+    ModelRegistry(ModelRegistry const&);
+    ModelRegistry& operator=(ModelRegistry const&);
+
+    Snapshot unload(Entry& entry);
+    void evict(std::string const& keep, std::vector<Snapshot>& evicted);
+
+public:
+    /// \param memory_budget The memory budget in bytes, 0 for no limit.
+    explicit ModelRegistry(size_t memory_budget=0);
+
+    /// Register the model file of a language.
+    void add(std::string const& language, std::string const& filename);
+    /// Register every file named `<language>.model` in a directory.
+    /// \return The number of registered languages.
+    long add_directory(std::string const& dirname);
+
+    /// Get the model of a language, loading it if necessary.
+    Snapshot get(std::string const& language);
+
+    /// Unload all models, they will be loaded again on next use.
+    void clear();
+
+    /// Estimated memory used by the loaded models in bytes.
+    size_t memory_usage() const;
+    /// Registered languages in alphabetical order.
+    std::vector<std::string> languages() const;
+    /// Currently loaded languages, most recently used first.
+    std::vector<std::string> loaded_languages() const;
+};
+
+} //namespace suflem
+
+#endif // REGISTRY_HPP_INCLUDED
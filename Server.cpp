@@ -0,0 +1,570 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Server.hpp"
+#include "Protocol.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+
+namespace suflem {
+
+// maximum number of bytes buffered for a connection, before it is closed
+size_t const MAX_PENDING_INPUT = protocol::MAX_FRAME_SIZE + 1024;
+int const MAX_EVENTS = 64;
+int const LISTEN_BACKLOG = 128;
+
+///////////////////////////////////////////////////////////////////////////////
+// Miscellaneous functions
+///////////////////////////////////////////////////////////////////////////////
+
+static std::string errno_string(std::string const& what) {
+    return what + ": " + strerror(errno);
+}
+
+static void set_nonblocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+static void set_nodelay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static sockaddr_un unix_address(std::string const& path)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + path);
+    }
+    strcpy(addr.sun_path, path.c_str());
+    return addr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Server methods
+///////////////////////////////////////////////////////////////////////////////
+
+Server::Server(HandlerFactory const& factory) :
+    _stopfd(-1), _stopped(false)
+{
+    _factory = [factory]() {
+        WorkerProtocol protocol;
+        protocol.connect = [factory](Responder const&) {
+            return factory();
+        };
+        return protocol;
+    };
+    _stopfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_stopfd < 0) {
+        throw std::runtime_error(errno_string("Could not create event loop"));
+    }
+}
+
+Server::Server(WorkerFactory const& factory) :
+    _factory(factory), _stopfd(-1), _stopped(false)
+{
+    _stopfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_stopfd < 0) {
+        throw std::runtime_error(errno_string("Could not create event loop"));
+    }
+}
+
+Server::~Server() {
+    for (size_t i=0 ; i<_listeners.size() ; ++i) {
+        close(_listeners[i]);
+    }
+    for (size_t i=0 ; i<_socket_paths.size() ; ++i) {
+        unlink(_socket_paths[i].c_str());
+    }
+    close(_stopfd);
+}
+
+void Server::add_listener(int fd) {
+    if (::listen(fd, LISTEN_BACKLOG) != 0) {
+        close(fd);
+        throw std::runtime_error(errno_string("Could not listen"));
+    }
+    set_nonblocking(fd);
+    _listeners.push_back(fd);
+}
+
+void Server::listen_unix(std::string const& path) {
+    sockaddr_un addr = unix_address(path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::runtime_error(errno_string("Could not create socket"));
+    }
+    // a stale socket file left by a dead server is removed, but the path of
+    // a running server is not taken over
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe >= 0) {
+        bool in_use = connect(probe, reinterpret_cast<sockaddr*>(&addr),
+                              sizeof(addr)) == 0;
+        close(probe);
+        if (in_use) {
+            close(fd);
+            throw std::runtime_error("Socket " + path + " is already in use");
+        }
+    }
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        throw std::runtime_error(errno_string("Could not bind " + path));
+    }
+    _socket_paths.push_back(path);
+    add_listener(fd);
+}
+
+void Server::listen_tcp(int port, std::string const& host)
+{
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* result = 0;
+    std::string service = std::to_string(port);
+    if (getaddrinfo(host.c_str(), service.c_str(), &hints, &result) != 0) {
+        throw std::runtime_error("Could not resolve " + host);
+    }
+    int fd = socket(result->ai_family, result->ai_socktype | SOCK_CLOEXEC,
+                    result->ai_protocol);
+    if (fd < 0) {
+        freeaddrinfo(result);
+        throw std::runtime_error(errno_string("Could not create socket"));
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    int rc = bind(fd, result->ai_addr, result->ai_addrlen);
+    freeaddrinfo(result);
+    if (rc != 0) {
+        close(fd);
+        throw std::runtime_error(errno_string("Could not bind " + host + ":" +
+                                              service));
+    }
+    add_listener(fd);
+}
+
+void Server::run(long num_threads) {
+    std::vector<Worker> workers(std::max(1L, num_threads));
+    for (size_t i=0 ; i<workers.size() ; ++i) {
+        workers[i].epfd = epoll_create1(EPOLL_CLOEXEC);
+        workers[i].timerfd = timerfd_create(CLOCK_MONOTONIC,
+                                            TFD_NONBLOCK | TFD_CLOEXEC);
+        workers[i].timer_armed = false;
+        workers[i].next_id = 0;
+        if (workers[i].epfd < 0 || workers[i].timerfd < 0) {
+            throw std::runtime_error(errno_string("Could not create event loop"));
+        }
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = _stopfd;
+        epoll_ctl(workers[i].epfd, EPOLL_CTL_ADD, _stopfd, &ev);
+        ev.data.fd = workers[i].timerfd;
+        epoll_ctl(workers[i].epfd, EPOLL_CTL_ADD, workers[i].timerfd, &ev);
+        // wake up only one of the workers for a new connection
+        for (size_t j=0 ; j<_listeners.size() ; ++j) {
+            ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+            ev.data.fd = _listeners[j];
+            epoll_ctl(workers[i].epfd, EPOLL_CTL_ADD, _listeners[j], &ev);
+        }
+    }
+
+    std::vector<std::exception_ptr> errors(workers.size());
+    std::vector<std::thread> threads;
+    auto run = [&](size_t i) {
+        try {
+            run_worker(workers[i]);
+        } catch (...) {
+            errors[i] = std::current_exception();
+            stop();
+        }
+    };
+    for (size_t i=1 ; i<workers.size() ; ++i) {
+        threads.push_back(std::thread(run, i));
+    }
+    run(0);
+    for (size_t i=0 ; i<threads.size() ; ++i) {
+        threads[i].join();
+    }
+
+    for (size_t i=0 ; i<workers.size() ; ++i) {
+        auto& connections = workers[i].connections;
+        for (auto j=connections.begin() ; j!=connections.end() ; ++j) {
+            close(j->first);
+        }
+        close(workers[i].epfd);
+        close(workers[i].timerfd);
+    }
+    // the eventfd stays signalled until all workers have seen it
+    uint64_t value;
+    if (read(_stopfd, &value, sizeof(value)) < 0) {
+        // nothing to reset
+    }
+    _stopped = false;
+    for (size_t i=0 ; i<errors.size() ; ++i) {
+        if (errors[i]) {
+            std::rethrow_exception(errors[i]);
+        }
+    }
+}
+
+void Server::run_worker(Worker& w) {
+    w.protocol = _factory();
+    epoll_event events[MAX_EVENTS];
+    while (!_stopped) {
+        int n = epoll_wait(w.epfd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(errno_string("epoll_wait failed"));
+        }
+        for (int i=0 ; i<n ; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == _stopfd) {
+                _stopped = true;
+            } else if (fd == w.timerfd) {
+                uint64_t expirations;
+                if (read(fd, &expirations, sizeof(expirations)) < 0) {
+                    // a spurious wakeup
+                }
+                w.timer_armed = false;
+            } else if (std::find(_listeners.begin(), _listeners.end(), fd)
+                       != _listeners.end()) {
+                accept_connections(w, fd);
+            } else if (w.connections.count(fd) == 0) {
+                // closed earlier in this batch of events
+                continue;
+            } else if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                // the peer is gone and can not receive responses. hangups
+                // are reported even without interest bits, so a connection
+                // waiting for a deferred response would wake up the worker
+                // again and again.
+                close_connection(w, fd);
+            } else if (events[i].events & EPOLLIN) {
+                on_readable(w, fd);
+            } else if (events[i].events & EPOLLOUT) {
+                flush(w, fd);
+            }
+        }
+        run_protocol(w);
+    }
+}
+
+void Server::run_protocol(Worker& w) {
+    if (w.protocol.run) {
+        long delay = w.protocol.run();
+        if (delay >= 0 || w.timer_armed) {
+            // a zero timer would disarm the timerfd
+            itimerspec spec;
+            memset(&spec, 0, sizeof(spec));
+            if (delay >= 0) {
+                delay = std::max(1L, delay);
+                spec.it_value.tv_sec = delay / 1000000;
+                spec.it_value.tv_nsec = (delay % 1000000) * 1000;
+            }
+            timerfd_settime(w.timerfd, 0, &spec, 0);
+            w.timer_armed = delay >= 0;
+        }
+    }
+    // send the responses deferred by the protocol
+    std::vector<int> ready;
+    ready.swap(w.ready);
+    for (size_t i=0 ; i<ready.size() ; ++i) {
+        if (w.connections.count(ready[i]) > 0) {
+            flush(w, ready[i]);
+        }
+    }
+}
+
+void Server::stop() {
+    uint64_t one = 1;
+    if (write(_stopfd, &one, sizeof(one)) < 0) {
+        // the eventfd is already signalled
+    }
+}
+
+void Server::accept_connections(Worker& w, int listener) {
+    while (true) {
+        int fd = accept4(listener, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            // EAGAIN means the backlog is empty, other errors concern
+            // the aborted connection only
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return;
+        }
+        set_nodelay(fd);
+        Connection& c = w.connections[fd];
+        Responder responder;
+        responder._worker = &w;
+        responder._fd = fd;
+        responder._id = ++w.next_id;
+        c.handler  = w.protocol.connect(responder);
+        c.written  = 0;
+        c.id       = responder._id;
+        c.deferred = 0;
+        c.close    = false;
+        c.events   = EPOLLIN;
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(w.epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+void Server::on_readable(Worker& w, int fd) {
+    Connection& c = w.connections[fd];
+    char buffer[1 << 16];
+    bool eof = false;
+    while (true) {
+        ssize_t r = read(fd, buffer, sizeof(buffer));
+        if (r > 0) {
+            c.in.append(buffer, r);
+            // complete requests are handled after every read, so only a
+            // single oversized request exceeds the limit, not a long
+            // pipeline of valid ones
+            if (!c.close) {
+                try {
+                    size_t consumed = c.handler(c.in.data(), c.in.size(),
+                                                c.out, c.close);
+                    c.in.erase(0, consumed);
+                } catch (std::exception&) {
+                    // drop the connection of a misbehaving client
+                    close_connection(w, fd);
+                    return;
+                }
+            }
+            if (c.in.size() > MAX_PENDING_INPUT) {
+                close_connection(w, fd);
+                return;
+            }
+        } else if (r == 0) {
+            eof = true;
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            close_connection(w, fd);
+            return;
+        }
+    }
+    if (eof) {
+        c.close = true;
+    }
+    flush(w, fd);
+}
+
+void Server::flush(Worker& w, int fd) {
+    Connection& c = w.connections[fd];
+    while (c.written < c.out.size()) {
+        ssize_t n = write(fd, c.out.data() + c.written,
+                          c.out.size() - c.written);
+        if (n >= 0) {
+            c.written += n;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            close_connection(w, fd);
+            return;
+        }
+    }
+    bool pending = c.written < c.out.size();
+    if (!pending) {
+        c.out.clear();
+        c.written = 0;
+        if (c.close && c.deferred == 0) {
+            close_connection(w, fd);
+            return;
+        }
+    }
+    // wait for the socket to become writable only while output is pending,
+    // and stop reading from connections about to be closed
+    uint32_t events = pending ? uint32_t(EPOLLOUT) :
+                      c.close ? 0u : uint32_t(EPOLLIN);
+    if (events != c.events) {
+        epoll_event ev;
+        ev.events = events;
+        ev.data.fd = fd;
+        epoll_ctl(w.epfd, EPOLL_CTL_MOD, fd, &ev);
+        c.events = events;
+    }
+}
+
+void Server::close_connection(Worker& w, int fd) {
+    epoll_ctl(w.epfd, EPOLL_CTL_DEL, fd, 0);
+    close(fd);
+    w.connections.erase(fd);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Responder methods
+///////////////////////////////////////////////////////////////////////////////
+
+void Server::Responder::defer() const {
+    auto it = _worker->connections.find(_fd);
+    if (it != _worker->connections.end() && it->second.id == _id) {
+        ++it->second.deferred;
+    }
+}
+
+void Server::Responder::respond(std::string const& data) const {
+    auto it = _worker->connections.find(_fd);
+    // no deferred responses are left after fail()
+    if (it == _worker->connections.end() || it->second.id != _id ||
+        it->second.deferred == 0)
+    {
+        return;
+    }
+    // sent by the worker after the current round of events, as the
+    // connection may be in use further up the stack
+    it->second.out.append(data);
+    --it->second.deferred;
+    _worker->ready.push_back(_fd);
+}
+
+void Server::Responder::fail() const {
+    auto it = _worker->connections.find(_fd);
+    if (it == _worker->connections.end() || it->second.id != _id) {
+        return;
+    }
+    it->second.deferred = 0;
+    it->second.close = true;
+    _worker->ready.push_back(_fd);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Client methods
+///////////////////////////////////////////////////////////////////////////////
+
+Client::Client(std::string const& socket_path) :
+    _fd(-1)
+{
+    sockaddr_un addr = unix_address(socket_path);
+    _fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (_fd < 0) {
+        throw std::runtime_error(errno_string("Could not create socket"));
+    }
+    if (connect(_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(_fd);
+        throw std::runtime_error(errno_string("Could not connect to " +
+                                              socket_path));
+    }
+}
+
+Client::Client(std::string const& host, int port) :
+    _fd(-1)
+{
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = 0;
+    std::string service = std::to_string(port);
+    if (getaddrinfo(host.c_str(), service.c_str(), &hints, &result) != 0) {
+        throw std::runtime_error("Could not resolve " + host);
+    }
+    for (addrinfo* ai=result ; ai ; ai=ai->ai_next) {
+        _fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+                     ai->ai_protocol);
+        if (_fd < 0) {
+            continue;
+        }
+        if (connect(_fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(_fd);
+        _fd = -1;
+    }
+    freeaddrinfo(result);
+    if (_fd < 0) {
+        throw std::runtime_error("Could not connect to " + host + ":" +
+                                 service);
+    }
+    set_nodelay(_fd);
+}
+
+Client::~Client() {
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+void Client::send(std::vector<std::string> const& words)
+{
+    std::string out;
+    protocol::append_frame(words, out);
+    size_t written = 0;
+    while (written < out.size()) {
+        ssize_t w = write(_fd, out.data() + written, out.size() - written);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(errno_string("Could not send request"));
+        }
+        written += w;
+    }
+}
+
+void Client::receive(std::vector<std::string>& lemmas)
+{
+    char buffer[1 << 16];
+    while (true) {
+        size_t n = protocol::parse_frame(_buffer.data(), _buffer.size(),
+                                         lemmas);
+        if (n > 0) {
+            _buffer.erase(0, n);
+            return;
+        }
+        ssize_t r = read(_fd, buffer, sizeof(buffer));
+        if (r < 0 && errno == EINTR) {
+            continue;
+        } else if (r < 0) {
+            throw std::runtime_error(errno_string("Could not read response"));
+        } else if (r == 0) {
+            throw std::runtime_error("Server closed the connection.");
+        }
+        _buffer.append(buffer, r);
+    }
+}
+
+} // namespace suflem
@@ -0,0 +1,183 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SERVER_HPP_INCLUDED
+#define SERVER_HPP_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <atomic>
+#include <stdexcept>
+
+namespace suflem {
+
+/// Epoll based socket server.
+/// The server takes care of connections and buffering, while the wire
+/// protocol is implemented by handler functions. Each worker thread runs its
+/// own event loop, a connection is served by the worker that accepted it.
+class Server {
+public:
+    /// Protocol handler.
+    /// Consumes complete requests from the beginning of the input buffer
+    /// and appends the responses to `out`. May throw std::runtime_error on
+    /// malformed input, which closes the connection.
+    /// \param in The received, not yet consumed data.
+    /// \param size The number of bytes in `in`.
+    /// \param out The output buffer of the connection.
+    /// \param close Set to true to close the connection after the output
+    ///              has been sent.
+    /// \return The number of consumed bytes.
+    typedef std::function<size_t (char const* in, size_t size,
+                                  std::string& out, bool& close)> Handler;
+    /// Creates the handler of a new connection.
+    /// Called concurrently by the worker threads.
+    typedef std::function<Handler ()> HandlerFactory;
+
+    class Responder;
+    /// Protocol state shared by the connections of one worker thread, for
+    /// protocols answering requests of several connections together.
+    struct WorkerProtocol {
+        /// Creates the handler of a new connection of the worker.
+        /// The handler may leave requests unanswered and answer them later
+        /// through the responder of the connection.
+        std::function<Handler (Responder const& responder)> connect;
+        /// Deferred work of the worker. Called after every round of events
+        /// and when the requested time has passed.
+        /// \return Microseconds until the next call, -1 to wait for events.
+        std::function<long ()> run;
+    };
+    /// Creates the protocol state of a worker.
+    /// Called once by every worker thread.
+    typedef std::function<WorkerProtocol ()> WorkerFactory;
+
+private:
+    struct Connection {
+        Handler handler;
+        std::string in;
+        std::string out;
+        size_t written;
+        unsigned long id;
+        long deferred;
+        bool close;
+        uint32_t events;
+    };
+
+    struct Worker {
+        int epfd;
+        int timerfd;
+        bool timer_armed;
+        unsigned long next_id;
+        WorkerProtocol protocol;
+        std::vector<int> ready;  // connections with new deferred responses
+        std::unordered_map<int, Connection> connections;
+    };
+
+public:
+    /// Sends the deferred responses of a connection.
+    /// Must be used from the worker thread of the connection only.
+    class Responder {
+        friend class Server;
+        Worker* _worker;
+        int _fd;
+        unsigned long _id;
+
+    public:
+        /// Announce a response that is sent later.
+        /// The connection is not closed before the response is sent.
+        void defer() const;
+        /// Send a deferred response.
+        /// Responses are sent in the order of respond() calls. Nothing is
+        /// sent, if the connection has been closed meanwhile.
+        void respond(std::string const& data) const;
+        /// Give up a deferred response and close the connection, after
+        /// the responses sent before have been written. The other deferred
+        /// responses of the connection are dropped.
+        void fail() const;
+    };
+
+private:
+    WorkerFactory _factory;
+    int _stopfd;
+    std::atomic<bool> _stopped;
+    std::vector<int> _listeners;
+    std::vector<std::string> _socket_paths;
+
+    Server(Server const&);
+    Server& operator=(Server const&);
+
+    void add_listener(int fd);
+    void run_worker(Worker& w);
+    void accept_connections(Worker& w, int listener);
+    void on_readable(Worker& w, int fd);
+    void flush(Worker& w, int fd);
+    void close_connection(Worker& w, int fd);
+    void run_protocol(Worker& w);
+
+public:
+    Server(HandlerFactory const& factory);
+    Server(WorkerFactory const& factory);
+    ~Server();
+
+    /// Accept connections on a unix domain socket.
+    /// An existing file at `path` is replaced.
+    void listen_unix(std::string const& path);
+    /// Accept connections on a TCP port.
+    /// \param port The port number.
+    /// \param host The address to listen on, localhost by default.
+    void listen_tcp(int port, std::string const& host="127.0.0.1");
+
+    /// Serve connections until stop() is called.
+    /// \param num_threads The number of worker threads.
+    void run(long num_threads=1);
+    /// Make run() return. Safe to call from signal handlers.
+    void stop();
+};
+
+/// Blocking client for the suflem server protocol.
+class Client {
+    int _fd;
+    std::string _buffer;
+
+    Client(Client const&);
+    Client& operator=(Client const&);
+
+public:
+    /// Connect to a server listening on a unix domain socket.
+    explicit Client(std::string const& socket_path);
+    /// Connect to a server listening on a TCP port.
+    Client(std::string const& host, int port);
+    ~Client();
+
+    /// Send a batch of words to the server.
+    void send(std::vector<std::string> const& words);
+    /// Receive the response to the oldest batch sent.
+    void receive(std::vector<std::string>& lemmas);
+
+    /// Lemmatize a batch of words.
+    void lemmatize(std::vector<std::string> const& words,
+                   std::vector<std::string>& lemmas)
+    {
+        send(words);
+        receive(lemmas);
+    }
+};
+
+} //namespace suflem
+
+#endif // SERVER_HPP_INCLUDED
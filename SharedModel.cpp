@@ -0,0 +1,96 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SharedModel.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+namespace suflem {
+
+SharedModel::SharedModel(std::string const& filename) :
+    _path(filename),
+    _model(std::make_shared<Model>(Model::load(filename))),
+    _generation(1), _loading(false)
+{ }
+
+SharedModel::SharedModel(Snapshot const& model) :
+    _model(model), _generation(1), _loading(false)
+{ }
+
+SharedModel::~SharedModel() {
+    if (_loader.joinable()) {
+        _loader.join();
+    }
+}
+
+// readers drop their snapshots when they finish their requests, the
+// last reference is released here, outside of any request
+static void release(SharedModel::Snapshot& old) {
+    while (old.use_count() > 1) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    old.reset();
+}
+
+void SharedModel::publish(Snapshot const& model) {
+    Snapshot old = std::atomic_exchange(&_model, model);
+    _generation.fetch_add(1);
+    release(old);
+}
+
+bool SharedModel::replace(Snapshot expected, Snapshot const& model) {
+    Snapshot old = expected;
+    if (!std::atomic_compare_exchange_strong(&_model, &old, model)) {
+        return false;
+    }
+    _generation.fetch_add(1);
+    expected.reset();
+    release(old);
+    return true;
+}
+
+void SharedModel::reload() {
+    if (_path.size() == 0) {
+        throw std::runtime_error("The model was not loaded from a file.");
+    }
+    std::lock_guard<std::mutex> lock(_reload_mutex);
+    fprintf(stderr, "Reloading model from %s.\n", _path.c_str());
+    Snapshot model = std::make_shared<Model>(Model::load(_path));
+    publish(model);
+    fprintf(stderr, "Reloading model done!\n");
+}
+
+bool SharedModel::reload_async() {
+    if (_loading.exchange(true)) {
+        return false;
+    }
+    if (_loader.joinable()) {
+        _loader.join();
+    }
+    _loader = std::thread([this]() {
+        try {
+            reload();
+        } catch (std::exception& e) {
+            fprintf(stderr, "Reloading model failed: %s\n", e.what());
+        }
+        _loading = false;
+    });
+    return true;
+}
+
+} // namespace suflem
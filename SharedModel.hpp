@@ -0,0 +1,88 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SHAREDMODEL_HPP_INCLUDED
+#define SHAREDMODEL_HPP_INCLUDED
+
+#include "Model.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <stdexcept>
+
+namespace suflem {
+
+/// A model that can be replaced while it is being used.
+/// Readers take a snapshot of the current model and use it for the duration
+/// of a request. Publishing a new model does not affect requests running on
+/// older snapshots, an old model is freed once all its snapshots are gone.
+class SharedModel {
+public:
+    typedef std::shared_ptr<Model const> Snapshot;
+
+private:
+    std::string _path;
+    Snapshot _model;
+    std::atomic<unsigned long> _generation;
+    std::mutex _reload_mutex;
+    std::thread _loader;
+    std::atomic<bool> _loading;
+
+    SharedModel(SharedModel const&);
+    SharedModel& operator=(SharedModel const&);
+
+public:
+    /// Load the initial model from file specified by filename.
+    explicit SharedModel(std::string const& filename);
+    /// Share an already loaded model.
+    explicit SharedModel(Snapshot const& model);
+    ~SharedModel();
+
+    /// Take a snapshot of the current model.
+    Snapshot get() const { return std::atomic_load(&_model); }
+
+    /// Number of models published so far.
+    /// Cheap to poll, readers keeping a snapshot for long can compare it to
+    /// the generation they started with to find out about new models.
+    unsigned long generation() const { return _generation.load(); }
+
+    /// Replace the current model.
+    /// Waits until the previous model is no longer used and frees it, so
+    /// that readers never pay for destroying a model.
+    void publish(Snapshot const& model);
+
+    /// Replace the current model, if it is still `expected`.
+    /// Like publish(), but fails instead of overwriting a model published
+    /// by someone else meanwhile. The caller must not keep other
+    /// references to `expected`.
+    /// \return false, if the current model was not `expected`.
+    bool replace(Snapshot expected, Snapshot const& model);
+
+    /// Load the model again from its file and publish it.
+    /// If loading fails, the current model is kept.
+    void reload();
+
+    /// Run reload() in a background thread.
+    /// \return false, if a reload is already in progress.
+    bool reload_async();
+};
+
+} //namespace suflem
+
+#endif // SHAREDMODEL_HPP_INCLUDED
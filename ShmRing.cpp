@@ -0,0 +1,443 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ShmRing.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+namespace suflem {
+
+///////////////////////////////////////////////////////////////////////////////
+// Shared memory layout
+///////////////////////////////////////////////////////////////////////////////
+
+static char const SHM_MAGIC[8] = {'S', 'U', 'F', 'L', 'E', 'M', 'R', '2'};
+static size_t const CACHE_LINE = 64;
+// number of polling rounds before going to sleep on a futex. spinning
+// only helps when the other side runs on another cpu at the same time.
+static int const SPIN_ROUNDS = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? 2000 : 0;
+// milliseconds between liveness checks of the other side while waiting
+static long const LIVENESS_INTERVAL = 100;
+
+enum SlotState {
+    SLOT_FREE     = 0,
+    SLOT_CLAIMED  = 1,  // a client is writing a request
+    SLOT_REQUEST  = 2,  // waiting for the server
+    SLOT_RESPONSE = 3,  // the lemmas are ready
+    SLOT_FAILED   = 4   // the request was malformed or lemmas did not fit
+};
+
+struct ShmHeader {
+    char magic[8];
+    uint32_t num_slots;
+    uint32_t slot_size;
+    uint32_t server_pid;
+    // incremented for every request, the server sleeps on it
+    std::atomic<uint32_t> doorbell;
+    std::atomic<uint32_t> server_sleeping;
+    std::atomic<uint32_t> stopped;
+    // where clients start looking for a free slot
+    std::atomic<uint32_t> next_slot;
+};
+
+struct ShmSlot {
+    // the client sleeps on the state while waiting for a response
+    std::atomic<uint32_t> state;
+    std::atomic<uint32_t> client_sleeping;
+    uint32_t length;
+    // the client holding the slot, zero while it is free
+    std::atomic<uint32_t> client_pid;
+
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+};
+
+static inline size_t round_up(size_t n) {
+    return (n + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+}
+
+static inline size_t slot_stride(uint32_t slot_size) {
+    return round_up(sizeof(ShmSlot) + slot_size);
+}
+
+static inline size_t segment_size(uint32_t num_slots, uint32_t slot_size) {
+    return round_up(sizeof(ShmHeader)) + num_slots * slot_stride(slot_size);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Miscellaneous functions
+///////////////////////////////////////////////////////////////////////////////
+
+// futexes must not be private, as they are shared between processes
+static inline void futex_wait(std::atomic<uint32_t>* addr, uint32_t expected,
+                              long timeout_ms=-1)
+{
+    timespec ts;
+    ts.tv_sec  = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT,
+            expected, timeout_ms < 0 ? 0 : &ts, 0, 0);
+}
+
+static inline void futex_wake(std::atomic<uint32_t>* addr, int count) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE,
+            count, 0, 0, 0);
+}
+
+// a process that exists but belongs to another user is alive as well
+static inline bool is_alive(uint32_t pid) {
+    return kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+}
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static inline uint32_t read_uint32(char const* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline void write_uint32(char* p, uint32_t value) {
+    memcpy(p, &value, sizeof(value));
+}
+
+// encoded size of a batch of strings in a slot
+static size_t encoded_size(std::vector<std::string> const& words) {
+    size_t size = sizeof(uint32_t);
+    for (size_t i=0 ; i<words.size() ; ++i) {
+        size += sizeof(uint32_t) + words[i].size();
+    }
+    return size;
+}
+
+static void encode(std::vector<std::string> const& words, char* p) {
+    write_uint32(p, words.size());
+    p += sizeof(uint32_t);
+    for (size_t i=0 ; i<words.size() ; ++i) {
+        write_uint32(p, words[i].size());
+        p += sizeof(uint32_t);
+        memcpy(p, words[i].data(), words[i].size());
+        p += words[i].size();
+    }
+}
+
+// walk the strings of an encoded batch, returns false if it is malformed
+template <typename Function>
+static bool decode(char const* p, size_t size, Function fn) {
+    char const* end = p + size;
+    if (size < sizeof(uint32_t)) {
+        return false;
+    }
+    uint32_t count = read_uint32(p);
+    p += sizeof(uint32_t);
+    for (uint32_t i=0 ; i<count ; ++i) {
+        if (end - p < static_cast<long>(sizeof(uint32_t))) {
+            return false;
+        }
+        uint32_t length = read_uint32(p);
+        p += sizeof(uint32_t);
+        if (static_cast<uint32_t>(end - p) < length) {
+            return false;
+        }
+        fn(p, length);
+        p += length;
+    }
+    return p == end;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ShmRing methods
+///////////////////////////////////////////////////////////////////////////////
+
+ShmRing::ShmRing(std::string const& name, uint32_t num_slots,
+                 uint32_t slot_size) :
+    _name(name), _header(0), _size(0), _owner(true)
+{
+    if (num_slots < 1 || slot_size < 2 * sizeof(uint32_t)) {
+        throw std::runtime_error("Invalid shared memory ring dimensions.");
+    }
+    // a stale segment of a crashed server is replaced
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0660);
+    if (fd < 0) {
+        throw std::runtime_error("Could not create shared memory " + name +
+                                 ": " + strerror(errno));
+    }
+    _size = segment_size(num_slots, slot_size);
+    void* p = MAP_FAILED;
+    if (ftruncate(fd, _size) == 0) {
+        p = mmap(0, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (p == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        throw std::runtime_error("Could not map shared memory " + name);
+    }
+    _header = new (p) ShmHeader();
+    _header->num_slots = num_slots;
+    _header->slot_size = slot_size;
+    _header->server_pid = getpid();
+    _header->doorbell = 0;
+    _header->server_sleeping = 0;
+    _header->stopped = 0;
+    _header->next_slot = 0;
+    for (uint32_t i=0 ; i<num_slots ; ++i) {
+        ShmSlot* s = new (slot(i)) ShmSlot();
+        s->state = SLOT_FREE;
+        s->client_sleeping = 0;
+        s->length = 0;
+        s->client_pid = 0;
+    }
+    // clients check the magic, so it is written last
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(_header->magic, SHM_MAGIC, sizeof(SHM_MAGIC));
+}
+
+ShmRing::ShmRing(std::string const& name) :
+    _name(name), _header(0), _size(0), _owner(false)
+{
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open shared memory " + name +
+                                 ": " + strerror(errno));
+    }
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 &&
+        static_cast<size_t>(st.st_size) >= round_up(sizeof(ShmHeader)))
+    {
+        _size = st.st_size;
+        p = mmap(0, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (p == MAP_FAILED) {
+        throw std::runtime_error("Could not map shared memory " + name);
+    }
+    _header = static_cast<ShmHeader*>(p);
+    if (memcmp(_header->magic, SHM_MAGIC, sizeof(SHM_MAGIC)) != 0 ||
+        segment_size(_header->num_slots, _header->slot_size) != _size)
+    {
+        munmap(_header, _size);
+        throw std::runtime_error("Shared memory " + name +
+                                 " is not a suflem ring.");
+    }
+}
+
+ShmRing::~ShmRing() {
+    if (_owner) {
+        stop();
+        shm_unlink(_name.c_str());
+    }
+    munmap(_header, _size);
+}
+
+ShmSlot* ShmRing::slot(uint32_t i) const {
+    char* base = reinterpret_cast<char*>(_header) + round_up(sizeof(ShmHeader));
+    return reinterpret_cast<ShmSlot*>(base + i * slot_stride(_header->slot_size));
+}
+
+void ShmRing::serve(Function const& lemmatize) {
+    uint32_t const num_slots = _header->num_slots;
+    std::vector<std::string> words;
+    std::vector<std::string> lemmas;
+    int idle = 0;
+    while (!_header->stopped) {
+        bool found = false;
+        for (uint32_t i=0 ; i<num_slots ; ++i) {
+            ShmSlot* s = slot(i);
+            if (s->state.load(std::memory_order_acquire) != SLOT_REQUEST) {
+                continue;
+            }
+            found = true;
+            words.clear();
+            // the length is written by the client, read it once and keep
+            // the decoding within the slot
+            uint32_t const length = s->length;
+            bool valid = length <= _header->slot_size &&
+                         decode(s->data(), length,
+                                [&](char const* p, size_t n) {
+                                    words.push_back(std::string(p, n));
+                                });
+            uint32_t state = SLOT_FAILED;
+            if (valid) {
+                lemmatize(words, lemmas);
+                size_t size = encoded_size(lemmas);
+                if (size <= _header->slot_size) {
+                    encode(lemmas, s->data());
+                    s->length = size;
+                    state = SLOT_RESPONSE;
+                }
+            }
+            s->state.store(state);
+            if (s->client_sleeping.load()) {
+                futex_wake(&s->state, 1);
+            }
+        }
+        if (found) {
+            idle = 0;
+            continue;
+        }
+        if (++idle < SPIN_ROUNDS) {
+            cpu_relax();
+            continue;
+        }
+        // announce going to sleep, then check once more for requests that
+        // were posted before the announcement became visible
+        uint32_t seq = _header->doorbell.load();
+        _header->server_sleeping.store(1);
+        bool pending = false;
+        for (uint32_t i=0 ; i<num_slots && !pending ; ++i) {
+            pending = slot(i)->state.load() == SLOT_REQUEST;
+        }
+        if (!pending && !_header->stopped) {
+            futex_wait(&_header->doorbell, seq, LIVENESS_INTERVAL);
+        }
+        _header->server_sleeping.store(0);
+        idle = 0;
+        reclaim();
+    }
+}
+
+void ShmRing::reclaim() {
+    for (uint32_t i=0 ; i<_header->num_slots ; ++i) {
+        ShmSlot* s = slot(i);
+        uint32_t state = s->state.load();
+        if (state == SLOT_FREE || state == SLOT_REQUEST) {
+            continue;
+        }
+        // a slot claimed a moment ago may not have its pid yet
+        uint32_t pid = s->client_pid.load();
+        if (pid == 0 || is_alive(pid)) {
+            continue;
+        }
+        if (s->state.compare_exchange_strong(state, SLOT_FREE)) {
+            fprintf(stderr, "Freed ring slot %u of exited client %u.\n",
+                    i, pid);
+            s->client_pid.store(0);
+        }
+    }
+}
+
+bool ShmRing::server_alive() const {
+    return !_header->stopped && is_alive(_header->server_pid);
+}
+
+void ShmRing::stop() {
+    _header->stopped.store(1);
+    _header->doorbell.fetch_add(1);
+    futex_wake(&_header->doorbell, 1);
+}
+
+void ShmRing::lemmatize(std::vector<std::string> const& words,
+                        Visitor const& visit)
+{
+    uint32_t const num_slots = _header->num_slots;
+    size_t const size = encoded_size(words);
+    if (size > _header->slot_size) {
+        throw std::runtime_error("Batch does not fit into a ring slot.");
+    }
+    // claim a free slot
+    ShmSlot* s = 0;
+    uint32_t start = _header->next_slot.fetch_add(1) % num_slots;
+    while (!s) {
+        for (uint32_t k=0 ; k<num_slots ; ++k) {
+            ShmSlot* candidate = slot((start + k) % num_slots);
+            uint32_t expected = SLOT_FREE;
+            if (candidate->state.compare_exchange_strong(expected,
+                                                         SLOT_CLAIMED)) {
+                s = candidate;
+                break;
+            }
+        }
+        if (!s) {
+            if (!server_alive()) {
+                throw std::runtime_error("Lemmatization server stopped.");
+            }
+            sched_yield();
+        }
+    }
+    s->client_pid.store(getpid());
+
+    // post the request and ring the doorbell
+    encode(words, s->data());
+    s->length = size;
+    s->state.store(SLOT_REQUEST);
+    _header->doorbell.fetch_add(1);
+    if (_header->server_sleeping.load()) {
+        futex_wake(&_header->doorbell, 1);
+    }
+
+    // wait for the response, spinning first
+    uint32_t state = SLOT_REQUEST;
+    for (int i=0 ; i<SPIN_ROUNDS && state == SLOT_REQUEST ; ++i) {
+        cpu_relax();
+        state = s->state.load(std::memory_order_acquire);
+    }
+    if (state == SLOT_REQUEST) {
+        s->client_sleeping.store(1);
+        while ((state = s->state.load()) == SLOT_REQUEST) {
+            if (!server_alive()) {
+                s->client_sleeping.store(0);
+                throw std::runtime_error("Lemmatization server stopped.");
+            }
+            futex_wait(&s->state, SLOT_REQUEST, LIVENESS_INTERVAL);
+        }
+        s->client_sleeping.store(0);
+    }
+
+    bool valid = false;
+    try {
+        valid = state == SLOT_RESPONSE && decode(s->data(), s->length, visit);
+    } catch (...) {
+        s->client_pid.store(0);
+        s->state.store(SLOT_FREE, std::memory_order_release);
+        throw;
+    }
+    s->client_pid.store(0);
+    s->state.store(SLOT_FREE, std::memory_order_release);
+    if (!valid) {
+        throw std::runtime_error("Lemmatization request failed.");
+    }
+}
+
+void ShmRing::lemmatize(std::vector<std::string> const& words,
+                        std::vector<std::string>& lemmas)
+{
+    lemmas.clear();
+    lemmatize(words, [&lemmas](char const* p, size_t n) {
+        lemmas.push_back(std::string(p, n));
+    });
+}
+
+} // namespace suflem
@@ -0,0 +1,87 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SHMRING_HPP_INCLUDED
+#define SHMRING_HPP_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+
+namespace suflem {
+
+struct ShmHeader;
+struct ShmSlot;
+
+/// Shared memory request/response ring for clients on the same host.
+/// The ring consists of fixed size slots. A client claims a free slot,
+/// writes a batch of words into it and marks it as a request. The server
+/// lemmatizes the words and writes the lemmas back into the same slot,
+/// where the client reads them. Slot states are changed with atomic
+/// operations, waiting is done with futexes only when there is no work.
+/// Slot payloads use the encoding of protocol frames without the length
+/// prefix, see Protocol.hpp. Both sides record their pids, so clients fail
+/// when the server dies and the server frees the slots of dead clients.
+class ShmRing {
+    std::string _name;
+    ShmHeader* _header;
+    size_t _size;
+    bool _owner;
+
+    ShmRing(ShmRing const&);
+    ShmRing& operator=(ShmRing const&);
+
+    ShmSlot* slot(uint32_t i) const;
+    void reclaim();
+    bool server_alive() const;
+
+public:
+    /// Batch lemmatization function of the server.
+    typedef std::function<void (std::vector<std::string> const& words,
+                                std::vector<std::string>& lemmas)> Function;
+    /// Called by ShmRing::lemmatize for each lemma of a batch.
+    /// The lemma points into shared memory and is valid during the call only.
+    typedef std::function<void (char const* lemma, size_t size)> Visitor;
+
+    /// Create a new ring as server.
+    /// \param name The POSIX shared memory object name, e.g. "/suflem".
+    /// \param num_slots The number of concurrent requests.
+    /// \param slot_size The maximum encoded size of a batch in bytes.
+    ShmRing(std::string const& name, uint32_t num_slots, uint32_t slot_size);
+    /// Attach to the ring of a running server as client.
+    explicit ShmRing(std::string const& name);
+    ~ShmRing();
+
+    /// Server side: answer requests until stop() is called.
+    void serve(Function const& lemmatize);
+    /// Server side: make serve() return. Safe to call from signal handlers.
+    void stop();
+
+    /// Client side: lemmatize a batch of words.
+    /// The words are encoded directly into the shared memory and the lemmas
+    /// are passed to `visit` in the order of the words, without copying.
+    void lemmatize(std::vector<std::string> const& words,
+                   Visitor const& visit);
+    /// Client side: lemmatize a batch of words, copying the lemmas.
+    void lemmatize(std::vector<std::string> const& words,
+                   std::vector<std::string>& lemmas);
+};
+
+} //namespace suflem
+
+#endif // SHMRING_HPP_INCLUDED
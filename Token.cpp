@@ -0,0 +1,303 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Token.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <strings.h>
+#include <unistd.h>
+
+namespace suflem {
+namespace token {
+
+///////////////////////////////////////////////////////////////////////////////
+// Miscellaneous functions
+///////////////////////////////////////////////////////////////////////////////
+
+// decode the utf-8 sequence at the beginning of `s`.
+// returns its length, or 0 if it is not valid utf-8.
+static inline size_t decode_utf8(unsigned char const* s, size_t size,
+                                 unsigned long& cp)
+{
+    size_t len;
+    if (s[0] >= 0xC2 && s[0] < 0xE0) {
+        len = 2;
+        cp = s[0] & 0x1F;
+    } else if (s[0] >= 0xE0 && s[0] < 0xF0) {
+        len = 3;
+        cp = s[0] & 0x0F;
+    } else if (s[0] >= 0xF0 && s[0] < 0xF5) {
+        len = 4;
+        cp = s[0] & 0x07;
+    } else {
+        return 0;
+    }
+    if (len > size) {
+        return 0;
+    }
+    for (size_t i=1 ; i<len ; ++i) {
+        if ((s[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+        cp = (cp << 6) | (s[i] & 0x3F);
+    }
+    return len;
+}
+
+static inline void append_utf8(unsigned long cp, std::string& out) {
+    if (cp < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+    } else if (cp < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+    }
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+}
+
+// lower case of a non-ascii code point
+static inline unsigned long fold_codepoint(unsigned long cp) {
+    if (cp < 0x100) {
+        // latin-1, except the multiplication sign
+        return (cp >= 0xC0 && cp <= 0xDE && cp != 0xD7) ? cp + 0x20 : cp;
+    } else if (cp < 0x180) {
+        // latin extended-a, capitals and small letters alternate
+        if (cp == 0x130) {
+            return 'i';
+        } else if (cp == 0x178) {
+            return 0xFF;
+        } else if ((cp >= 0x139 && cp <= 0x148) ||
+                   (cp >= 0x179 && cp <= 0x17E)) {
+            return cp % 2 == 1 ? cp + 1 : cp;
+        } else if (cp <= 0x137 || (cp >= 0x14A && cp <= 0x177)) {
+            return cp % 2 == 0 ? cp + 1 : cp;
+        }
+    } else if (cp >= 0x386 && cp <= 0x3A9) {
+        // greek
+        if (cp >= 0x391 && cp != 0x3A2) {
+            return cp + 0x20;
+        } else if (cp == 0x386) {
+            return 0x3AC;
+        } else if (cp >= 0x388 && cp <= 0x38A) {
+            return cp + 0x25;
+        } else if (cp == 0x38C) {
+            return 0x3CC;
+        } else if (cp >= 0x38E && cp <= 0x38F) {
+            return cp + 0x3F;
+        }
+    } else if (cp >= 0x400 && cp <= 0x42F) {
+        // cyrillic
+        return cp < 0x410 ? cp + 0x50 : cp + 0x20;
+    }
+    return cp;
+}
+
+// non-ascii punctuation and symbols
+static inline bool is_punctuation(unsigned long cp) {
+    return (cp >= 0xA1 && cp <= 0xBF) || cp == 0xD7 || cp == 0xF7 ||
+           (cp >= 0x2010 && cp <= 0x205E) ||  // general punctuation
+           (cp >= 0x20A0 && cp <= 0x20CF) ||  // currency symbols
+           (cp >= 0x3000 && cp <= 0x303F);    // cjk punctuation
+}
+
+static inline bool starts_with(char const* data, size_t size,
+                               char const* prefix)
+{
+    size_t n = strlen(prefix);
+    return size > n && strncasecmp(data, prefix, n) == 0;
+}
+
+static bool is_url(char const* data, size_t size) {
+    if (starts_with(data, size, "http://") ||
+        starts_with(data, size, "https://") ||
+        starts_with(data, size, "ftp://") ||
+        starts_with(data, size, "www.") ||
+        starts_with(data, size, "mailto:"))
+    {
+        return true;
+    }
+    // e-mail addresses
+    char const* at = static_cast<char const*>(memchr(data, '@', size));
+    if (!at || at == data) {
+        return false;
+    }
+    char const* dot = static_cast<char const*>(
+        memchr(at, '.', size - (at - data)));
+    return dot && dot > at + 1 && dot < data + size - 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Token functions
+///////////////////////////////////////////////////////////////////////////////
+
+Class normalize(char const* data, size_t size, bool fold, std::string& out) {
+    unsigned char const* s = reinterpret_cast<unsigned char const*>(data);
+    bool digit = false;
+    bool letter = false;
+    out.clear();
+    out.reserve(size);
+    for (size_t i=0 ; i<size ; ) {
+        unsigned char c = s[i];
+        if (c < 0x80) {
+            // ascii fast path
+            if (c >= 'A' && c <= 'Z') {
+                letter = true;
+                c = fold ? c + ('a' - 'A') : c;
+            } else if (c >= '0' && c <= '9') {
+                digit = true;
+            } else if (c <= ' ' || c >= 0x7F ||
+                       (c >= 'a' && c <= 'z')) {
+                letter = true;
+            }
+            out.push_back(static_cast<char>(c));
+            ++i;
+            continue;
+        }
+        unsigned long cp;
+        size_t len = decode_utf8(s + i, size - i, cp);
+        if (len == 0) {
+            // not utf-8, leave the rest to the lemmatizer
+            out.append(data + i, size - i);
+            letter = true;
+            break;
+        }
+        if (!is_punctuation(cp)) {
+            letter = true;
+        }
+        unsigned long folded = fold ? fold_codepoint(cp) : cp;
+        if (folded == cp) {
+            out.append(data + i, len);
+        } else if (folded < 0x80) {
+            out.push_back(static_cast<char>(folded));
+        } else {
+            append_utf8(folded, out);
+        }
+        i += len;
+    }
+    // classified after the loop, so that `out` holds every kind of token
+    if (is_url(data, size)) {
+        return URL;
+    }
+    if (digit) {
+        return NUMBER;
+    }
+    return letter ? WORD : PUNCTUATION;
+}
+
+} // namespace token
+
+///////////////////////////////////////////////////////////////////////////////
+// TokenReader methods
+///////////////////////////////////////////////////////////////////////////////
+
+static inline bool is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+TokenReader::TokenReader(int fd) :
+    _fd(fd), _buffer(1 << 16), _begin(0), _end(0), _eof(false),
+    _offset(0), _token_offset(0)
+{ }
+
+bool TokenReader::next(char const*& data, size_t& size) {
+    while (true) {
+        while (_begin < _end && is_space(_buffer[_begin])) {
+            ++_begin;
+        }
+        size_t end = _begin;
+        while (end < _end && !is_space(_buffer[end])) {
+            ++end;
+        }
+        // a token is complete when followed by a space or the end of input
+        if (end < _end || (_eof && end > _begin)) {
+            data = &_buffer[_begin];
+            size = end - _begin;
+            _token_offset = _offset + _begin;
+            _begin = end;
+            return true;
+        }
+        if (_eof) {
+            return false;
+        }
+        // keep the partial token and read more
+        memmove(&_buffer[0], &_buffer[_begin], _end - _begin);
+        _offset += _begin;
+        _end -= _begin;
+        _begin = 0;
+        if (_end == _buffer.size()) {
+            _buffer.resize(2 * _buffer.size());
+        }
+        ssize_t r = read(_fd, &_buffer[_end], _buffer.size() - _end);
+        if (r > 0) {
+            _end += r;
+        } else if (r == 0 || errno != EINTR) {
+            _eof = true;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// LineReader methods
+///////////////////////////////////////////////////////////////////////////////
+
+LineReader::LineReader(int fd) :
+    _fd(fd), _buffer(1 << 16), _begin(0), _scanned(0), _end(0), _eof(false)
+{ }
+
+bool LineReader::next(char const*& data, size_t& size) {
+    while (true) {
+        char const* nl = static_cast<char const*>(
+            memchr(_buffer.data() + _scanned, '\n', _end - _scanned));
+        if (nl) {
+            data = &_buffer[_begin];
+            size = nl - data;
+            _begin = _scanned = nl - &_buffer[0] + 1;
+            return true;
+        }
+        _scanned = _end;
+        if (_eof) {
+            // the last line may lack the newline
+            if (_begin == _end) {
+                return false;
+            }
+            data = &_buffer[_begin];
+            size = _end - _begin;
+            _begin = _end;
+            return true;
+        }
+        // keep the partial line and read more
+        memmove(&_buffer[0], &_buffer[_begin], _end - _begin);
+        _end -= _begin;
+        _scanned = _end;
+        _begin = 0;
+        if (_end == _buffer.size()) {
+            _buffer.resize(2 * _buffer.size());
+        }
+        ssize_t r = read(_fd, &_buffer[_end], _buffer.size() - _end);
+        if (r > 0) {
+            _end += r;
+        } else if (r == 0 || errno != EINTR) {
+            _eof = true;
+        }
+    }
+}
+
+} // namespace suflem
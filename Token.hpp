@@ -0,0 +1,108 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TOKEN_HPP_INCLUDED
+#define TOKEN_HPP_INCLUDED
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace suflem {
+
+/// Preprocessing of input tokens before lemmatization.
+namespace token {
+
+/// Classes of tokens.
+enum Class {
+    WORD,         ///< anything else, to be lemmatized
+    PUNCTUATION,  ///< punctuation and symbols only, like `.` or `--`
+    NUMBER,       ///< contains digits, like `3.14`, `2013-10-17` or `utf-8`
+    URL           ///< web or e-mail address
+};
+
+/// Classify a token and normalize it in a single pass.
+/// \param data The utf-8 encoded token.
+/// \param size The number of bytes in the token.
+/// \param fold If true, the token is converted to lower case.
+/// \param out Set to the normalized token, whatever its class. Case folding
+///            maps ASCII, Latin-1, Latin Extended-A, Greek and Cyrillic
+///            capitals, other characters are copied as they are.
+/// \return The class of the token.
+Class normalize(char const* data, size_t size, bool fold, std::string& out);
+
+} // namespace token
+
+/// Splits input from a file descriptor into whitespace separated tokens.
+/// Reads large blocks, but returns the tokens of partial blocks as soon as
+/// they are complete, so interactive input is answered without delay.
+class TokenReader {
+    int _fd;
+    std::vector<char> _buffer;
+    size_t _begin;
+    size_t _end;
+    bool _eof;
+    unsigned long long _offset;        // input offset of the buffer
+    unsigned long long _token_offset;  // input offset of the last token
+
+    TokenReader(TokenReader const&);
+    TokenReader& operator=(TokenReader const&);
+
+public:
+    /// \param fd The file descriptor to read, standard input by default.
+    explicit TokenReader(int fd=0);
+
+    /// Get the next token.
+    /// \param data Set to the beginning of the token, valid until the next
+    ///             call.
+    /// \param size Set to the size of the token in bytes.
+    /// \return false at the end of input.
+    bool next(char const*& data, size_t& size);
+
+    /// Byte offset of the last token from the beginning of input.
+    unsigned long long offset() const { return _token_offset; }
+};
+
+/// Splits input from a file descriptor into lines.
+/// Buffers like TokenReader, lines are returned as slices of the buffer
+/// without copying them.
+class LineReader {
+    int _fd;
+    std::vector<char> _buffer;
+    size_t _begin;
+    size_t _scanned;  // no newline in [_begin, _scanned)
+    size_t _end;
+    bool _eof;
+
+    LineReader(LineReader const&);
+    LineReader& operator=(LineReader const&);
+
+public:
+    /// \param fd The file descriptor to read, standard input by default.
+    explicit LineReader(int fd=0);
+
+    /// Get the next line.
+    /// \param data Set to the beginning of the line, valid until the next
+    ///             call.
+    /// \param size Set to the size of the line in bytes, without the
+    ///             newline.
+    /// \return false at the end of input.
+    bool next(char const*& data, size_t& size);
+};
+
+} //namespace suflem
+
+#endif // TOKEN_HPP_INCLUDED
@@ -0,0 +1,85 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef UTF8_HPP_INCLUDED
+#define UTF8_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace suflem {
+
+// Code point helpers of Model, in a header of their own so that the
+// microbenchmarks can measure them while Model still inlines them.
+
+/// Find the beginnings of utf-8 code points in a string.
+/// \param s The string.
+/// \param v Set to the byte indices of the code points in `s`.
+/// \return false, if `s` is not valid utf-8.
+inline bool store_codepoints(std::string const& s, std::vector<long>& v) {
+    const long masks[] = {0, 0x6, 0xE, 0x1E, 0x3E, 0x7E};
+    const long shift[] = {7, 5, 4, 3, 2, 1};
+    const long n = static_cast<long>(s.size());
+    v.clear();
+    for (long i=0 ; i<n ; ++i) {
+        bool found_start = false;
+        unsigned char c = static_cast<unsigned char>(s[i]);
+        for (int j=0 ; j<6 ; ++j) {
+            if (c >> shift[j] == masks[j]) { // we detect a code point
+                v.push_back(i);
+                found_start = true;
+                break;
+            }
+        }
+        if (!found_start) {
+            if (c >> 6 != 0x2 || i == 0) {
+                // utf-8 decode error
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/// Count the code points two strings have in common at their beginning.
+/// \param acodepoints The code points of `a`, see store_codepoints().
+/// \param bcodepoints The code points of `b`.
+/// \return The length of the common prefix in code points.
+inline
+long common_prefix_size(std::string const& a, std::string const& b,
+                        std::vector<long> const& acodepoints,
+                        std::vector<long> const& bcodepoints)
+{
+    long N = std::min(acodepoints.size(), bcodepoints.size());
+    long preflen = 0;
+    for (long j=0 ; j<N ; ++j) {
+        if (acodepoints[j] != bcodepoints[j]) {
+            return j;
+        }
+        for (long i=preflen ; i<acodepoints[j] ; ++i) {
+            if (a[i] != b[i]) {
+                return j;
+            }
+        }
+        preflen = acodepoints[j];
+    }
+    return N;
+}
+
+} //namespace suflem
+
+#endif // UTF8_HPP_INCLUDED
@@ -0,0 +1,272 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Microbenchmarks of the hot functions of Model, built and run by
+// `scons bench`. Every result is written as a tab separated line:
+//   benchmark  model_size  word_length  lookups  ns_per_op  iterations
+// model_size is the number of training examples, lookups the number of
+// suffix lookups a lemmatization does, and - marks a parameter that does
+// not apply.
+
+#include "Model.hpp"
+#include "Utf8.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace suflem;
+
+typedef std::chrono::steady_clock Clock;
+
+// maximal suffix length of the synthetic models
+static const long MAX_SUFFIX_SIZE = 8;
+
+// minimum time spent in each benchmark
+static double min_time = 0.2;
+
+// keeps results alive, so that the compiler does not drop the work
+static volatile long sink = 0;
+
+// run `fn(iterations)` with growing iteration counts until it takes at
+// least min_time seconds, and return the time per iteration in ns
+template <typename Function>
+static double measure(Function fn, long& iterations) {
+    for (iterations=1 ; ; iterations*=2) {
+        Clock::time_point start = Clock::now();
+        fn(iterations);
+        double elapsed = std::chrono::duration<double>(
+            Clock::now() - start).count();
+        if (elapsed >= min_time || iterations >= (1L << 40)) {
+            return 1e9 * elapsed / iterations;
+        }
+    }
+}
+
+static void report(char const* benchmark, long model_size, long word_length,
+                   long lookups, double ns, long iterations)
+{
+    std::string fields[3];
+    long values[3] = {model_size, word_length, lookups};
+    for (int i=0 ; i<3 ; ++i) {
+        fields[i] = values[i] < 0 ? "-" : std::to_string(values[i]);
+    }
+    printf("%s\t%s\t%s\t%s\t%.1f\t%ld\n", benchmark, fields[0].c_str(),
+           fields[1].c_str(), fields[2].c_str(), ns, iterations);
+    fflush(stdout);
+}
+
+// letters of the synthetic words, the last ones are two bytes in utf-8.
+// capital letters never occur, they make suffixes unknown to the model.
+static char const* const LETTERS[] = {
+    "a", "b", "d", "e", "g", "h", "i", "j", "k", "l", "m", "n", "o", "p",
+    "r", "s", "t", "u", "v", "õ", "ä", "ö", "ü"
+};
+static char const* const ENDINGS[] = {
+    "", "d", "le", "lt", "st", "ga", "ks", "ta", "sse", "tele", "dega"
+};
+
+static std::string random_stem(std::mt19937& random, long length) {
+    std::string stem;
+    for (long i=0 ; i<length ; ++i) {
+        stem += LETTERS[random() % (sizeof(LETTERS) / sizeof(LETTERS[0]))];
+    }
+    return stem;
+}
+
+// path of the temporary files of the benchmarks
+static std::string temp_path(char const* kind) {
+    return "/tmp/suflem-microbench-" + std::to_string(getpid()) + "." + kind;
+}
+
+// a model trained with `size` examples of stems inflected by a few endings
+static Model synthetic_model(long size, std::vector<std::string>& words) {
+    std::mt19937 random(size);
+    std::string path = temp_path("train");
+    FILE* fout = fopen(path.c_str(), "w");
+    if (!fout) {
+        throw std::runtime_error("Could not open file " + path);
+    }
+    words.clear();
+    size_t const num_endings = sizeof(ENDINGS) / sizeof(ENDINGS[0]);
+    for (long i=0 ; i<size ; ++i) {
+        std::string stem = random_stem(random, 3 + random() % 5);
+        std::string inflected = stem + ENDINGS[random() % num_endings];
+        fprintf(fout, "%s\t%sa\t%ld\n", inflected.c_str(), stem.c_str(),
+                static_cast<long>(1 + random() % 100));
+        words.push_back(inflected);
+    }
+    fclose(fout);
+    Model model = Model::train(path, MAX_SUFFIX_SIZE);
+    unlink(path.c_str());
+    return model;
+}
+
+static void bench_codepoints(std::vector<long> const& lengths) {
+    std::mt19937 random(1);
+    for (size_t l=0 ; l<lengths.size() ; ++l) {
+        std::string a = random_stem(random, lengths[l]);
+        std::string b = a;
+        b[b.size() - 1] = 'Z';
+        std::vector<long> acp, bcp;
+        long iterations;
+        double ns = measure([&](long n) {
+            for (long i=0 ; i<n ; ++i) {
+                sink += store_codepoints(a, acp);
+            }
+        }, iterations);
+        report("store_codepoints", -1, lengths[l], -1, ns, iterations);
+
+        store_codepoints(a, acp);
+        store_codepoints(b, bcp);
+        ns = measure([&](long n) {
+            for (long i=0 ; i<n ; ++i) {
+                sink += common_prefix_size(a, b, acp, bcp);
+            }
+        }, iterations);
+        report("common_prefix_size", -1, lengths[l], -1, ns, iterations);
+    }
+}
+
+static void bench_update(long size, std::vector<long> const& lengths) {
+    std::vector<std::string> words;
+    Model model = synthetic_model(size, words);
+    std::mt19937 random(2);
+    for (size_t l=0 ; l<lengths.size() ; ++l) {
+        std::vector<std::string> stems(1024);
+        for (size_t i=0 ; i<stems.size() ; ++i) {
+            stems[i] = random_stem(random, lengths[l]);
+        }
+        // update() is protected, feedback() adds examples the same way
+        long iterations;
+        double ns = measure([&](long n) {
+            for (long i=0 ; i<n ; ++i) {
+                std::string const& stem = stems[i % stems.size()];
+                model.feedback(stem + "st", stem + "a", 1);
+            }
+        }, iterations);
+        report("Model::update", size, lengths[l], -1, ns, iterations);
+    }
+}
+
+static void bench_lemmatize(long size, std::vector<long> const& lengths) {
+    std::vector<std::string> words;
+    Model model = synthetic_model(size, words);
+    words.resize(std::min<size_t>(words.size(), 1024));
+    std::string lemma;
+
+    // unknown letters in front of known words are skipped one lookup at a
+    // time, until the remaining suffix is found
+    for (long k=0 ; k<=MAX_SUFFIX_SIZE ; ++k) {
+        std::vector<std::string> queries(words.size());
+        for (size_t i=0 ; i<words.size() ; ++i) {
+            queries[i] = std::string(k, 'Q') + words[i];
+        }
+        long iterations;
+        double ns = measure([&](long n) {
+            for (long i=0 ; i<n ; ++i) {
+                sink += model.lemmatize(queries[i % queries.size()], lemma);
+            }
+        }, iterations);
+        report("Model::lemmatize_hit", size, -1, k == 0 ? 1 : k + 2,
+               ns, iterations);
+    }
+
+    for (size_t l=0 ; l<lengths.size() ; ++l) {
+        std::string query(lengths[l], 'Q');
+        long iterations;
+        double ns = measure([&](long n) {
+            for (long i=0 ; i<n ; ++i) {
+                sink += model.lemmatize(query, lemma);
+            }
+        }, iterations);
+        report("Model::lemmatize_miss", size, lengths[l], lengths[l] + 2,
+               ns, iterations);
+    }
+}
+
+static void bench_load_save(long size) {
+    std::vector<std::string> words;
+    Model model = synthetic_model(size, words);
+    std::string path = temp_path("model");
+    long iterations;
+    double ns = measure([&](long n) {
+        for (long i=0 ; i<n ; ++i) {
+            Model::save(model, path);
+        }
+    }, iterations);
+    report("Model::save", size, -1, -1, ns, iterations);
+    ns = measure([&](long n) {
+        for (long i=0 ; i<n ; ++i) {
+            sink += Model::load(path).is_trimmed();
+        }
+    }, iterations);
+    report("Model::load", size, -1, -1, ns, iterations);
+    unlink(path.c_str());
+}
+
+// parse a comma separated list of numbers
+static std::vector<long> parse_list(std::string const& s) {
+    std::vector<long> values;
+    std::stringstream in(s);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        values.push_back(atol(item.c_str()));
+    }
+    return values;
+}
+
+int main(int argc, char** argv) {
+    std::vector<long> sizes = parse_list("1000,10000,100000");
+    std::vector<long> lengths = parse_list("4,8,16,32");
+    for (int i=1 ; i<argc ; ++i) {
+        std::string s(argv[i]);
+        if (s.substr(0, 8) == "--sizes=") {
+            sizes = parse_list(s.substr(8));
+        } else if (s.substr(0, 10) == "--lengths=") {
+            lengths = parse_list(s.substr(10));
+        } else if (sscanf(argv[i], "--time=%lf", &min_time) == 1) {
+            continue;
+        } else {
+            fprintf(stderr, "usage: microbench [--sizes=n,...] "
+                            "[--lengths=n,...] [--time=seconds]\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    try {
+        printf("benchmark\tmodel_size\tword_length\tlookups\t"
+               "ns_per_op\titerations\n");
+        bench_codepoints(lengths);
+        for (size_t s=0 ; s<sizes.size() ; ++s) {
+            bench_update(sizes[s], lengths);
+            bench_lemmatize(sizes[s], lengths);
+            bench_load_save(sizes[s]);
+        }
+    } catch (std::exception& e) {
+        fprintf(stderr, "exception: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
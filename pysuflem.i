@@ -0,0 +1,135 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Python bindings of the suffix lemmatizer.
+// Build with scons, which runs swig and produces pysuflem.py and
+// _pysuflem.so.
+
+%module pysuflem
+
+%{
+#include "Model.hpp"
+
+#include <string>
+#include <vector>
+#include <exception>
+#include <new>
+
+// lemmatize a sequence of str, releasing the GIL meanwhile
+static PyObject* lemmatize_words(suflem::Model const& model, PyObject* words)
+{
+    PyObject* seq = PySequence_Fast(words, "words must be a sequence");
+    if (!seq) {
+        return NULL;
+    }
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    std::vector<std::string> inflected(n);
+    for (Py_ssize_t i=0 ; i<n ; ++i) {
+        PyObject* item = PySequence_Fast_GET_ITEM(seq, i);
+        Py_ssize_t size;
+        char const* utf8 = PyUnicode_Check(item) ?
+                           PyUnicode_AsUTF8AndSize(item, &size) : NULL;
+        if (!utf8) {
+            if (!PyErr_Occurred()) {
+                PyErr_SetString(PyExc_TypeError, "words must be str");
+            }
+            Py_DECREF(seq);
+            return NULL;
+        }
+        inflected[i].assign(utf8, size);
+    }
+    Py_DECREF(seq);
+
+    // the Python error is raised after taking the GIL back
+    std::vector<std::string> lemmas;
+    bool no_memory = false;
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        model.lemmatize(inflected, lemmas);
+    } catch (std::bad_alloc&) {
+        no_memory = true;
+    } catch (std::exception& e) {
+        error = e.what();
+        if (error.empty()) {
+            error = "lemmatization failed";
+        }
+    }
+    Py_END_ALLOW_THREADS
+    if (no_memory) {
+        return PyErr_NoMemory();
+    } else if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+
+    PyObject* result = PyList_New(n);
+    if (!result) {
+        return NULL;
+    }
+    for (Py_ssize_t i=0 ; i<n ; ++i) {
+        PyObject* lemma = PyUnicode_DecodeUTF8(lemmas[i].data(),
+                                               lemmas[i].size(),
+                                               "surrogateescape");
+        if (!lemma) {
+            Py_DECREF(result);
+            return NULL;
+        }
+        PyList_SET_ITEM(result, i, lemma);
+    }
+    return result;
+}
+%}
+
+%include "std_string.i"
+%include "exception.i"
+
+%exception {
+    try {
+        $action
+    } catch (std::bad_alloc&) {
+        SWIG_exception(SWIG_MemoryError, "out of memory");
+    } catch (std::exception& e) {
+        SWIG_exception(SWIG_RuntimeError, e.what());
+    }
+}
+
+// the part of the Model class exposed to Python
+%nodefaultctor suflem::Model;
+
+namespace suflem {
+
+class Model {
+public:
+    std::string lemmatize(std::string const& inflected) const;
+    void trim();
+    bool is_trimmed() const;
+    static Model train(std::string const& filename,
+                       long const max_suffix_size);
+    static Model load(std::string const& filename);
+    static void save(Model const& model, std::string const& filename);
+};
+
+%extend Model {
+    // lemmatize a list of words with one call. the GIL is released while
+    // lemmatizing, so that other Python threads can run meanwhile.
+    PyObject* lemmatize_batch(PyObject* words) const {
+        return lemmatize_words(*$self, words);
+    }
+}
+
+} // namespace suflem
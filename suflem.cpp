@@ -16,17 +16,88 @@
 */
 
 #include "Model.hpp"
+#include "Cache.hpp"
+#include "Server.hpp"
+#include "Protocol.hpp"
+#include "Http.hpp"
+#include "ShmRing.hpp"
+#include "SharedModel.hpp"
+#include "Feedback.hpp"
+#include "Registry.hpp"
+#include "Token.hpp"
+#include "Dictionary.hpp"
+#include "IoRing.hpp"
+#include "Json.hpp"
+#include "Alloc.hpp"
+#include "Corpus.hpp"
+#include "PerfCounters.hpp"
 
+#include <cerrno>
+#include <csignal>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <string>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 using namespace suflem;
 
 static const char* usage =
 "usage: suflem model_path [--train=path] [--maxlen=integer] [--flush]\n"
+"                         [--cache=path] [--lenient] [--lowercase]\n"
+"                         [--bypass] [--tsv=column | --jsonl=field]\n"
+"                         [--ids=path] [--offsets] [--framing=binary]\n"
+"                         [--stats]\n"
+"       suflem diff old_model new_model [vocab_path] [--threads=integer]\n"
+"       suflem freq model_path [input_path] [--threads=integer] [--lenient]\n"
+"                   [--lowercase]\n"
+"       suflem files model_path --out=directory [--threads=integer]\n"
+"                    [--lenient] [--no-uring] path...\n"
+"       suflem bench model_path [input_path] [--threads=integer]\n"
+"                    [--words=integer] [--seed=integer]\n"
+"       suflem generate train|tokens [--tokens=integer] [--seed=integer]\n"
+"                       [--vocabulary=integer] [--paradigms=integer]\n"
+"                       [--forms=integer] [--min-suffix=integer]\n"
+"                       [--max-suffix=integer] [--suffix-decay=float]\n"
+"                       [--non-ascii=float]\n"
+"       suflem bench-train [--sizes=integer,...] [--maxlens=integer,...]\n"
+"                          [--paradigms=integer] [--forms=integer]\n"
+"                          [--seed=integer] [--dir=directory]\n"
+"       suflem serve model_path [--socket=path] [--port=integer] [--http]\n"
+"                               [--threads=integer] [--shm=name]\n"
+"                               [--models=directory] [--memory=megabytes]\n"
+"                               [--shm-slots=integer]\n"
+"                               [--shm-slot-size=integer]\n"
+"                               [--bind=address] [--feedback=path]\n"
+"                               [--feedback-interval=seconds]\n"
+"                               [--coalesce=integer]\n"
+"                               [--coalesce-delay=microseconds]\n"
+"       suflem client [--socket=path] [--port=integer] [--host=address]\n"
+"                     [--shm=name] [--batch=integer]\n"
+"       suflem shard model_path num_shards out_prefix\n"
+"       suflem route --shards=address,... [--socket=path] [--port=integer]\n"
+"                    [--bind=address] [--threads=integer]\n"
+"\n"
 "model_path - the path to save the model during training and to load the\n"
 "             model during lemmatization.\n"
 "--train=path - if given, start the progam in training mode. All input read\n"
@@ -35,6 +106,31 @@ static const char* usage =
 "                   default value is 8.\n"
 "--flush    - if given, flush the output after each processed input line.\n"
 "             has no effect in training mode.\n"
+"--cache=path - persistent cache of lemmatization results. The cache is\n"
+"               created if missing and is discarded automatically when\n"
+"               the model changes. Has no effect in training mode.\n"
+"--lenient - pass words that are not valid utf-8 through unchanged instead\n"
+"            of stopping, and skip malformed lines in training mode.\n"
+"            Statistics of the run are written to standard error.\n"
+"--lowercase - convert words to lower case before lemmatizing them.\n"
+"--bypass  - write punctuation, numbers and URLs out unchanged without\n"
+"            lemmatizing them.\n"
+"--tsv=column - read tab separated records and lemmatize the words of the\n"
+"               given column (1-based). Other columns are written out\n"
+"               unchanged.\n"
+"--jsonl=field - read JSON objects, one per line, and lemmatize the words\n"
+"                of the given top level string field. Other fields are\n"
+"                written out unchanged.\n"
+"--ids=path - write dense integer lemma IDs instead of lemmas. IDs are\n"
+"             taken from the dictionary file at path, one lemma per line,\n"
+"             and new lemmas are appended to it.\n"
+"--offsets - append the byte offsets of each word in the input to its\n"
+"            output line as `<TAB>begin<TAB>end`, end being exclusive.\n"
+"--framing=binary - read and write length prefixed batches of words like\n"
+"                   the server mode, instead of whitespace separated words.\n"
+"--stats - write the numbers of words and the heap allocations of loading,\n"
+"          training, trimming and lemmatizing to standard error. The\n"
+"          allocations are counted only if built with `scons allocstats=1`.\n"
 "\n"
 "LEMMATIZATION MODE (default):\n"
 "Lemmatization mode reads one inflected word per line from standard input.\n"
@@ -42,6 +138,98 @@ static const char* usage =
 "the words. Lemmatized words are written to standard output, one word\n"
 "per line. In the same order as inflected words were read from standard\n"
 "input.\n"
+"With --tsv or --jsonl, whole records are read one per line instead and\n"
+"written out with the words of the selected field lemmatized. Records\n"
+"lacking the field are passed through, malformed records stop the program\n"
+"unless --lenient is given.\n"
+"Sending SIGHUP to the process reloads the model from `model_path` in the\n"
+"background. Words are lemmatized with the old model until the new one is\n"
+"loaded. The same applies to the server mode.\n"
+"\n"
+"DIFF MODE:\n"
+"Compares two models. Without `vocab_path`, the inflected suffixes, whose\n"
+"most probable replacement differs between the models, are written to\n"
+"standard output as `suffix<TAB>old_replacement<TAB>new_replacement`.\n"
+"Missing replacements are written as (none).\n"
+"With `vocab_path`, the words read from the file are lemmatized with both\n"
+"models using --threads threads (default: number of cpus) and the words,\n"
+"whose lemma changes, are written as `word<TAB>old_lemma<TAB>new_lemma`.\n"
+"\n"
+"FREQUENCY MODE:\n"
+"Reads a frequency list of `token<TAB>count` lines from `input_path` or\n"
+"standard input, lemmatizes the tokens using --threads threads (default:\n"
+"number of cpus) and writes the summed counts of the lemmas as\n"
+"`lemma<TAB>count`, most frequent first.\n"
+"\n"
+"FILES MODE:\n"
+"Lemmatizes many files in one process. Every input path is a file or a\n"
+"directory, whose regular files are processed. The lemmas of each file are\n"
+"written one per line into a file of the same name in the --out directory.\n"
+"Files are read and written through io_uring, overlapped with the\n"
+"lemmatization by --threads threads (default: number of cpus). Where\n"
+"io_uring is not available, or with --no-uring, pread and pwrite are used.\n"
+"\n"
+"BENCH MODE:\n"
+"Loads the model and lemmatizes the words of `input_path`, or a synthetic\n"
+"stream of --words words (default 1000000) drawn from the model with\n"
+"Zipfian frequencies, first in one thread and then in --threads threads.\n"
+"Writes `name<TAB>value` lines: model load time and memory, words per\n"
+"second, nanoseconds and allocations per word, hardware performance\n"
+"counters per word where the kernel allows them, and latency percentiles.\n"
+"\n"
+"TRAINING BENCHMARK:\n"
+"bench-train generates training data of --sizes lemmas (default\n"
+"1000,10000,100000) like the generate mode and trains a model from each\n"
+"with every --maxlens value (default 4,8,12). Writes a table of the\n"
+"training lines and suffix updates per second, the peak memory, the table\n"
+"sizes before and after trimming, the time spent trimming and saving, and\n"
+"the hardware performance counters per line where the kernel allows them.\n"
+"The data and models are written to temporary files in --dir (default\n"
+"/tmp).\n"
+"\n"
+"GENERATE MODE:\n"
+"Writes training data (train) or a stream of --tokens tokens (tokens,\n"
+"default 1000000) of a synthetic language to standard output. The language\n"
+"has --vocabulary lemmas (default 100000) inflected by --paradigms\n"
+"paradigms (default 50) of --forms forms (default 12), with endings of\n"
+"--min-suffix to --max-suffix letters (default 1 to 6), each longer one\n"
+"--suffix-decay times as likely (default 0.6), and a --non-ascii share of\n"
+"letters outside ASCII (default 0.1). The output depends only on the\n"
+"arguments and --seed.\n"
+"\n"
+"SERVER MODE:\n"
+"Loads the model once and answers lemmatization requests on a unix domain\n"
+"socket (--socket) and/or a TCP port (--port) until interrupted. The TCP\n"
+"port is bound to localhost, unless another address is given by --bind.\n"
+"Requests and responses are length prefixed batches of words, see README.\n"
+"With --coalesce, the requests of many connections are lemmatized together\n"
+"in batches of up to --coalesce words. A request waits at most\n"
+"--coalesce-delay microseconds (default 0, no waiting) for others to join.\n"
+"With --http, the server speaks HTTP/1.1 instead: words POSTed to\n"
+"/lemmatize one per line or as a JSON array are answered in the same format.\n"
+"POST /reload reloads the model like SIGHUP does.\n"
+"With --models, the `<language>.model` files in the directory are served\n"
+"at /lemmatize/<language>. They are loaded on first use, and the least\n"
+"recently used ones are unloaded when their memory exceeds --memory\n"
+"megabytes (default 0, unlimited). model_path is optional in that case.\n"
+"With --feedback, corrections POSTed to /feedback as lines of\n"
+"`inflected<TAB>lemma<TAB>count` are applied to the served model and\n"
+"published every --feedback-interval seconds (default 10). They are\n"
+"appended to the --feedback file and applied again on restart.\n"
+"--threads sets the number of worker threads (default 1).\n"
+"With --shm, the server also answers clients on the same host through a\n"
+"shared memory ring of --shm-slots slots (default 64), each holding a batch\n"
+"of up to --shm-slot-size bytes (default 65536).\n"
+"The client mode reads words from standard input like the lemmatization\n"
+"mode, sends them to a server in batches of --batch words (default 1000)\n"
+"and writes the lemmas to standard output.\n"
+"\n"
+"SHARDING:\n"
+"The shard mode splits a model by the final character of words into\n"
+"num_shards models saved as out_prefix.0, out_prefix.1, ... Each shard is\n"
+"served by its own server. The route mode accepts requests like a server\n"
+"and forwards each word to the shard owning it. Shard addresses are unix\n"
+"socket paths or host:port pairs, listed in the order of shard indices.\n"
 "\n"
 "TRAINING MODE:\n"
 "To train a new model, the `suflem` program requires input in\n"
@@ -88,79 +276,2589 @@ static inline std::string &trim(std::string &s) {
     return ltrim(rtrim(s));
 }
 
+// write the allocations accounted to each phase to standard error, per
+// word for the lemmatization phase
+static void report_allocations(long words) {
+    if (!alloc::accounting()) {
+        fprintf(stderr, "Allocations are not accounted, build with "
+                        "`scons allocstats=1`.\n");
+        return;
+    }
+    for (int p=0 ; p<alloc::NUM_PHASES ; ++p) {
+        alloc::Phase phase = static_cast<alloc::Phase>(p);
+        alloc::Usage usage = alloc::usage(phase);
+        fprintf(stderr, "Allocations in %s: %ld, bytes: %ld", alloc::name(phase),
+                usage.count, usage.bytes);
+        if (phase == alloc::LEMMATIZE && words > 0) {
+            fprintf(stderr, " (%.2f and %.1f per word)",
+                    static_cast<double>(usage.count) / words,
+                    static_cast<double>(usage.bytes) / words);
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
 void train_model(std::string const& model_path, std::string const& train_path,
-                 long const max_suffix_size)
+                 long const max_suffix_size, bool lenient, bool stats)
 {
     fprintf(stderr, "Training model from dataset %s.\n", train_path.c_str());
-    Model model = Model::train(train_path, max_suffix_size);
+    Model::TrainingStats counts;
+    alloc::Phase const previous = alloc::set_phase(alloc::TRAIN);
+    Model model = Model::train(train_path, max_suffix_size,
+                               lenient ? &counts : 0);
+    alloc::set_phase(previous);
+    if (lenient) {
+        fprintf(stderr, "Training lines used: %ld, skipped: %ld\n",
+                counts.lines, counts.skipped);
+    }
     fprintf(stderr, "Trimming model.\n");
-    model.trim();
+    {
+        alloc::PhaseScope phase(alloc::TRIM);
+        model.trim();
+    }
     fprintf(stderr, "Saving model to %s\n", model_path.c_str());
     Model::save(model, model_path);
+    if (stats) {
+        report_allocations(0);
+    }
     fprintf(stderr, "Done!\n");
 }
 
-void lemmatize_input(std::string const& model_path, bool flush_lines) {
+// Calls a reload function whenever the process receives SIGHUP.
+// SIGHUP is blocked in the calling thread and in all threads it creates
+// afterwards, so the object must be created before any worker threads.
+class HangupReloader {
+    std::function<void ()> _reload;
+    std::atomic<bool> _stop;
+    std::thread _thread;
+
+public:
+    HangupReloader(std::function<void ()> const& reload) :
+        _reload(reload), _stop(false)
+    {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGHUP);
+        pthread_sigmask(SIG_BLOCK, &set, 0);
+        _thread = std::thread([this, set]() {
+            timespec timeout = {0, 200000000};
+            while (!_stop) {
+                if (sigtimedwait(&set, 0, &timeout) != SIGHUP) {
+                    continue;
+                }
+                try {
+                    _reload();
+                } catch (std::exception& e) {
+                    fprintf(stderr, "Reloading model failed: %s\n", e.what());
+                }
+            }
+        });
+    }
+
+    ~HangupReloader() {
+        _stop = true;
+        _thread.join();
+    }
+};
+
+// options of the lemmatization mode
+struct LemmatizeOptions {
+    std::string model_path;
+    std::string cache_path;
+    bool flush_lines;
+    bool lenient;
+    bool lowercase;
+    bool bypass;
+    long tsv_column;         // 1-based column of TSV records, 0 if not TSV
+    std::string json_field;  // field of JSON Lines records, empty if not JSONL
+    std::string ids_path;    // lemma dictionary, empty for lemma strings
+    bool offsets;
+    bool binary;             // length prefixed frames instead of text
+    bool stats;
+
+    LemmatizeOptions() : flush_lines(false), lenient(false),
+                         lowercase(false), bypass(false), tsv_column(0),
+                         offsets(false), binary(false), stats(false) {}
+};
+
+// append the decimal digits of `n` to `out`
+static inline void append_number(unsigned long long n, std::string& out) {
+    char digits[24];
+    char* p = digits + sizeof(digits);
+    do {
+        *--p = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+    out.append(p, digits + sizeof(digits) - p);
+}
+
+static inline bool is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// locate the `column`th (1-based) tab separated column of a line.
+// returns false, if the line has fewer columns.
+static bool find_column(char const* line, size_t size, long column,
+                        size_t& begin, size_t& end)
+{
+    begin = 0;
+    for (long i=1 ; i<column ; ++i) {
+        char const* tab = static_cast<char const*>(
+            memchr(line + begin, '\t', size - begin));
+        if (!tab) {
+            return false;
+        }
+        begin = tab - line + 1;
+    }
+    char const* tab = static_cast<char const*>(
+        memchr(line + begin, '\t', size - begin));
+    end = tab ? tab - line : size;
+    return true;
+}
+
+// locate the string value of a top level field of a JSON object.
+// [begin, end) is set to the quoted value and `value` to its decoded
+// contents. returns false, if the object has no such field or its value is
+// not a string.
+static bool find_json_field(char const* line, size_t size,
+                            std::string const& field, size_t& begin,
+                            size_t& end, std::string& value)
+{
+    char const* p = line;
+    char const* const last = line + size;
+    std::string key;
+    json::skip_space(p, last);
+    if (p == last || *p++ != '{') {
+        throw std::runtime_error("Expected a JSON object.");
+    }
+    json::skip_space(p, last);
+    if (p < last && *p == '}') {
+        return false;
+    }
+    while (true) {
+        json::skip_space(p, last);
+        if (p == last || *p++ != '"') {
+            throw std::runtime_error("Expected a key in JSON object.");
+        }
+        json::parse_string(p, last, key);
+        json::skip_space(p, last);
+        if (p == last || *p++ != ':') {
+            throw std::runtime_error("Expected ':' in JSON object.");
+        }
+        json::skip_space(p, last);
+        if (key == field && p < last && *p == '"') {
+            begin = p - line;
+            ++p;
+            json::parse_string(p, last, value);
+            end = p - line;
+            return true;
+        }
+        json::skip_value(p, last);
+        json::skip_space(p, last);
+        if (p < last && *p == ',') {
+            ++p;
+        } else if (p < last && *p == '}') {
+            return false;
+        } else {
+            throw std::runtime_error("Expected ',' or '}' in JSON object.");
+        }
+    }
+}
+
+void lemmatize_input(LemmatizeOptions const& opts) {
+    std::string const& model_path = opts.model_path;
+    std::string const& cache_path = opts.cache_path;
+    bool const lenient = opts.lenient;
     fprintf(stderr, "Loading model from %s.\n", model_path.c_str());
-    Model model = Model::load(model_path);
+    alloc::Phase const previous = alloc::set_phase(alloc::LOAD);
+    SharedModel shared(model_path);
+    alloc::set_phase(previous);
     fprintf(stderr, "Loading model done!\n");
+    HangupReloader reloader([&shared]() { shared.reload(); });
+
+    // the snapshot is renewed when a reloaded model has been published
+    unsigned long generation = 0;
+    SharedModel::Snapshot model;
+    std::unique_ptr<LemmaCache> cache;
+    auto renew = [&]() {
+        if (generation == shared.generation()) {
+            return;
+        }
+        generation = shared.generation();
+        model = shared.get();
+        if (cache_path.size() > 0) {
+            // a new model invalidates the cached results
+            cache.reset();
+            try {
+                cache.reset(new LemmaCache(cache_path, model->fingerprint()));
+                fprintf(stderr, "Using cache %s with %ld entries.\n",
+                        cache_path.c_str(), cache->size());
+            } catch (std::exception& e) {
+                fprintf(stderr, "Not using cache: %s\n", e.what());
+            }
+        }
+    };
+
+    // number of words by Model::Status, without cached words
+    long counts[3] = {0, 0, 0};
+    auto lemmatize = [&](std::string const& word, std::string& lemma) {
+        alloc::PhaseScope phase(alloc::LEMMATIZE);
+        Model::Status status = model->lemmatize(word, lemma);
+        if (status == Model::INVALID && !lenient) {
+            throw std::runtime_error("Utf-8 decode error!");
+        }
+        ++counts[status];
+    };
+
+    // lemmatize a token and append the result to `out`.
+    // tokens are classified and case folded in the same pass.
+    std::string input;
+    std::string lemma;
+    auto process = [&](char const* token, size_t size, std::string& out) {
+        if (opts.lowercase || opts.bypass) {
+            token::Class tclass = token::normalize(token, size,
+                                                   opts.lowercase, input);
+            if (opts.bypass && tclass != token::WORD) {
+                out.append(token, size);
+                return;
+            }
+        } else {
+            input.assign(token, size);
+        }
+        if (!cache) {
+            lemmatize(input, lemma);
+        } else if (!cache->find(input, lemma)) {
+            lemmatize(input, lemma);
+            try {
+                cache->insert(input, lemma);
+            } catch (std::runtime_error& e) {
+                // e.g. the disk is full, carry on without the cache
+                fprintf(stderr, "Not using cache any more: %s\n", e.what());
+                cache.reset();
+            }
+        }
+        out.append(lemma);
+    };
+
+    // lemmatize the words of a record field, keeping the whitespace
+    auto process_field = [&](char const* data, size_t size,
+                             std::string& out) {
+        size_t i = 0;
+        while (i < size) {
+            size_t j = i;
+            while (j < size && is_space(data[j])) {
+                ++j;
+            }
+            out.append(data + i, j - i);
+            i = j;
+            while (j < size && !is_space(data[j])) {
+                ++j;
+            }
+            if (j > i) {
+                process(data + i, j - i, out);
+            }
+            i = j;
+        }
+    };
+
+    std::string out;
+    long malformed = 0;
+    if (opts.binary) {
+        // frames are read and written with plain system calls, bypassing
+        // stdio. responses are written before more input is read.
+        protocol::FrameWriter writer(1);
+        std::vector<std::string> words;
+        std::vector<std::string> lemmas;
+        std::vector<char> buffer(1 << 16);
+        size_t begin = 0;
+        size_t end = 0;
+        while (true) {
+            while (size_t n = protocol::parse_frame(buffer.data() + begin,
+                                                    end - begin, words))
+            {
+                begin += n;
+                renew();
+                lemmas.resize(words.size());
+                for (size_t i=0 ; i<words.size() ; ++i) {
+                    lemmas[i].clear();
+                    process(words[i].data(), words[i].size(), lemmas[i]);
+                }
+                writer.write(lemmas);
+            }
+            // keep the partial frame and read more
+            memmove(buffer.data(), buffer.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+            if (end == buffer.size()) {
+                buffer.resize(2 * buffer.size());
+            }
+            ssize_t r = read(0, buffer.data() + end, buffer.size() - end);
+            if (r < 0 && errno == EINTR) {
+                continue;
+            } else if (r < 0) {
+                throw std::runtime_error("Could not read input.");
+            } else if (r == 0) {
+                break;
+            }
+            end += r;
+        }
+        if (end > 0) {
+            throw std::runtime_error("Truncated frame at end of input.");
+        }
+    } else if (opts.tsv_column == 0 && opts.json_field.size() == 0) {
+        // lemma IDs are kept stable across runs by loading the dictionary
+        // of earlier runs and appending the new lemmas to it
+        std::unique_ptr<LemmaDictionary> dictionary;
+        if (opts.ids_path.size() > 0) {
+            if (access(opts.ids_path.c_str(), F_OK) == 0) {
+                dictionary.reset(new LemmaDictionary(opts.ids_path));
+                fprintf(stderr, "Loaded %ld lemma IDs from %s.\n",
+                        static_cast<long>(dictionary->size()),
+                        opts.ids_path.c_str());
+            } else {
+                dictionary.reset(new LemmaDictionary());
+            }
+        }
+        TokenReader reader;
+        char const* token;
+        size_t size;
+        try {
+            while (reader.next(token, size)) {
+                renew();
+                out.clear();
+                process(token, size, out);
+                if (dictionary) {
+                    long id = dictionary->id(out);
+                    out.clear();
+                    append_number(id, out);
+                }
+                if (opts.offsets) {
+                    out.push_back('\t');
+                    append_number(reader.offset(), out);
+                    out.push_back('\t');
+                    append_number(reader.offset() + size, out);
+                }
+                out.push_back('\n');
+                fwrite(out.data(), 1, out.size(), stdout);
+                if (opts.flush_lines) {
+                    // store new IDs before anyone sees them
+                    if (dictionary) {
+                        dictionary->append(opts.ids_path);
+                    }
+                    fflush(stdout);
+                }
+            }
+        } catch (...) {
+            // the IDs written so far must stay valid
+            if (dictionary) {
+                dictionary->append(opts.ids_path);
+            }
+            throw;
+        }
+        if (dictionary) {
+            fprintf(stderr, "Lemma IDs: %ld, new: %ld\n",
+                    static_cast<long>(dictionary->size()),
+                    static_cast<long>(dictionary->added()));
+            dictionary->append(opts.ids_path);
+        }
+    } else {
+        // records are written as slices of the input buffer around the
+        // lemmatized field, only the field itself is copied
+        LineReader reader;
+        char const* line;
+        size_t size;
+        std::string value;
+        std::string field;
+        long lineno = 0;
+        while (reader.next(line, size)) {
+            ++lineno;
+            renew();
+            size_t begin = 0;
+            size_t end = 0;
+            bool found;
+            out.clear();
+            try {
+                if (opts.tsv_column > 0) {
+                    found = find_column(line, size, opts.tsv_column,
+                                        begin, end);
+                    if (found) {
+                        process_field(line + begin, end - begin, out);
+                    }
+                } else {
+                    found = find_json_field(line, size, opts.json_field,
+                                            begin, end, value);
+                    if (found) {
+                        field.clear();
+                        process_field(value.data(), value.size(), field);
+                        json::append_string(field, out);
+                    }
+                }
+            } catch (std::exception& e) {
+                if (!lenient) {
+                    throw std::runtime_error(std::string(e.what()) +
+                                             " on line " +
+                                             std::to_string(lineno));
+                }
+                ++malformed;
+                found = false;
+            }
+            if (!found) {
+                // records without the field are passed through
+                begin = end = size;
+                out.clear();
+            }
+            fwrite(line, 1, begin, stdout);
+            fwrite(out.data(), 1, out.size(), stdout);
+            fwrite(line + end, 1, size - end, stdout);
+            putchar('\n');
+            if (opts.flush_lines) {
+                fflush(stdout);
+            }
+        }
+    }
+    fflush(stdout);
+    if (cache) {
+        fprintf(stderr, "Cache hits: %ld, misses: %ld, entries: %ld\n",
+                cache->hits(), cache->misses(), cache->size());
+    }
+    if (lenient || opts.stats) {
+        fprintf(stderr,
+                "Words lemmatized: %ld, unchanged: %ld, invalid: %ld\n",
+                counts[Model::LEMMATIZED], counts[Model::UNCHANGED],
+                counts[Model::INVALID]);
+        if (malformed > 0) {
+            fprintf(stderr, "Malformed records passed through: %ld\n",
+                    malformed);
+        }
+    }
+    if (opts.stats) {
+        report_allocations(counts[Model::LEMMATIZED] +
+                           counts[Model::UNCHANGED] + counts[Model::INVALID]);
+    }
+}
+
+// run fn(begin, end) on consecutive chunks of range [0, n) in parallel.
+// the first exception thrown by fn is rethrown after all threads finished.
+template <typename Function>
+static void parallel_for(long n, long num_threads, Function fn) {
+    num_threads = std::max(1L, std::min(num_threads, n));
+    const long chunk = (n + num_threads - 1) / num_threads;
+    std::vector<std::exception_ptr> errors(num_threads);
+    std::vector<std::thread> threads;
+    auto run = [&](long t) {
+        try {
+            fn(std::min(n, t*chunk), std::min(n, (t+1)*chunk));
+        } catch (...) {
+            errors[t] = std::current_exception();
+        }
+    };
+    for (long t=1 ; t<num_threads ; ++t) {
+        threads.push_back(std::thread(run, t));
+    }
+    run(0);
+    for (size_t t=0 ; t<threads.size() ; ++t) {
+        threads[t].join();
+    }
+    for (long t=0 ; t<num_threads ; ++t) {
+        if (errors[t]) {
+            std::rethrow_exception(errors[t]);
+        }
+    }
+}
+
+static void print_replacement_diff(Model const& old_model,
+                                   Model const& new_model)
+{
+    // sort the suffixes for stable output
+    std::set<std::string> suffixes;
+    std::vector<std::string> v = old_model.inflected_suffixes();
+    suffixes.insert(v.begin(), v.end());
+    v = new_model.inflected_suffixes();
+    suffixes.insert(v.begin(), v.end());
+
+    std::string old_lemsuf, new_lemsuf;
+    long numchanged = 0;
+    for (auto i=suffixes.begin() ; i!=suffixes.end() ; ++i) {
+        bool old_found = old_model.best_replacement(*i, old_lemsuf);
+        bool new_found = new_model.best_replacement(*i, new_lemsuf);
+        if (old_found == new_found && (!old_found || old_lemsuf == new_lemsuf)) {
+            continue;
+        }
+        printf("%s\t%s\t%s\n", i->c_str(),
+               old_found ? old_lemsuf.c_str() : "(none)",
+               new_found ? new_lemsuf.c_str() : "(none)");
+        ++numchanged;
+    }
+    fprintf(stderr, "%ld of %ld suffixes changed their replacement.\n",
+            numchanged, static_cast<long>(suffixes.size()));
+}
 
+static void print_lemma_diff(Model const& old_model, Model const& new_model,
+                             std::string const& vocab_path, long num_threads)
+{
+    FILE* fin = fopen(vocab_path.c_str(), "rb");
+    if (!fin) {
+        throw std::runtime_error("Could not open file " + vocab_path);
+    }
+    std::vector<std::string> words;
     char buffer[1099];
     std::string input;
-    while (scanf("%1024s", buffer) == 1) {
+    while (fscanf(fin, "%1024s", buffer) == 1) {
         input = buffer;
-        input = trim(input);
-        printf("%s\n", model.lemmatize(input).c_str());
-        if (flush_lines) {
-            fflush(stdout);
+        words.push_back(trim(input));
+    }
+    fclose(fin);
+
+    // lemmas are stored only for words that change
+    const long n = words.size();
+    std::vector<std::string> old_lemmas(n), new_lemmas(n);
+    std::vector<char> changed(n, 0);
+    parallel_for(n, num_threads, [&](long begin, long end) {
+        for (long i=begin ; i<end ; ++i) {
+            std::string old_lemma = old_model.lemmatize(words[i]);
+            std::string new_lemma = new_model.lemmatize(words[i]);
+            if (old_lemma != new_lemma) {
+                old_lemmas[i].swap(old_lemma);
+                new_lemmas[i].swap(new_lemma);
+                changed[i] = 1;
+            }
+        }
+    });
+
+    long numchanged = 0;
+    for (long i=0 ; i<n ; ++i) {
+        if (changed[i]) {
+            printf("%s\t%s\t%s\n", words[i].c_str(),
+                   old_lemmas[i].c_str(), new_lemmas[i].c_str());
+            ++numchanged;
         }
     }
+    fprintf(stderr, "%ld of %ld words changed their lemma.\n", numchanged, n);
+}
+
+void diff_models(std::string const& old_path, std::string const& new_path,
+                 std::string const& vocab_path, long num_threads)
+{
+    fprintf(stderr, "Loading models from %s and %s.\n",
+            old_path.c_str(), new_path.c_str());
+    Model old_model = Model::load(old_path);
+    Model new_model = Model::load(new_path);
+    if (vocab_path.size() == 0) {
+        print_replacement_diff(old_model, new_model);
+    } else {
+        print_lemma_diff(old_model, new_model, vocab_path, num_threads);
+    }
     fflush(stdout);
 }
 
-int main(int argc, char** argv) {
-    std::string model_path = "";
-    std::string train_path = "";
-    bool train_mode  = false;
-    bool flush_lines = false;
-    long maxlen = 8;
+int diff_main(int argc, char** argv) {
+    std::vector<std::string> paths;
+    long num_threads = std::thread::hardware_concurrency();
+    for (int i=2 ; i<argc ; ++i) {
+        std::string s(argv[i]);
+        if (sscanf(argv[i], "--threads=%ld", &num_threads) == 1) {
+            continue;
+        } else if (s.size() > 0 && s[0] != '-' && paths.size() < 3) {
+            paths.push_back(s);
+        } else {
+            fprintf(stderr, ("Invalid argument: " + s + '\n').c_str());
+            exit(-1);
+        }
+    }
+    if (paths.size() < 2) {
+        fprintf(stderr, "old_model and new_model not given!\n");
+        exit(-1);
+    }
+    paths.resize(3);
 
-    const std::string TRAIN_FLAG = "--train=";
-    const std::string FLUSH_FLAG = "--flush";
-    const std::string HELP_FLAG  = "-h";
-    const std::string HELP_FLAG2 = "--help";
+    try {
+        diff_models(paths[0], paths[1], paths[2], num_threads);
+    } catch (std::exception& e) {
+        fprintf(stderr, "exception: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
 
-    // try to parse arguments
-    for (int i=1 ; i<argc ; ++i) {
+struct FreqOptions {
+    std::string model_path;
+    std::string input_path;  // standard input, if empty
+    long num_threads;
+    bool lenient;
+    bool lowercase;
+
+    FreqOptions() : num_threads(std::thread::hardware_concurrency()),
+                    lenient(false), lowercase(false) {}
+};
+
+// lines read and lemmatized at a time
+static const size_t FREQ_BATCH_LINES = 1 << 16;
+
+// parse the count at the end of a frequency list line
+static bool parse_count(char const* p, char const* end, long long& count) {
+    while (end > p && is_space(end[-1])) {
+        --end;
+    }
+    if (p == end) {
+        return false;
+    }
+    count = 0;
+    for ( ; p<end ; ++p) {
+        if (*p < '0' || *p > '9') {
+            return false;
+        }
+        count = 10 * count + (*p - '0');
+    }
+    return true;
+}
+
+// read `token<TAB>count` lines, lemmatize the tokens and write the summed
+// counts of each lemma, most frequent first.
+// batches of lines are lemmatized in parallel. the counts are then summed
+// in parallel too, every thread owning the lemmas of one hash partition,
+// so that no locking is needed and each lemma is stored only once.
+void lemma_frequencies(FreqOptions const& opts) {
+    fprintf(stderr, "Loading model from %s.\n", opts.model_path.c_str());
+    Model model = Model::load(opts.model_path);
+    fprintf(stderr, "Loading model done!\n");
+
+    int fd = 0;
+    if (opts.input_path.size() > 0) {
+        fd = open(opts.input_path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open file " + opts.input_path);
+        }
+    }
+    const long num_threads = std::max(1L, opts.num_threads);
+    typedef std::unordered_map<std::string, long long> Counts;
+    std::vector<Counts> partitions(num_threads);
+    // LineReader reuses its buffer, so the tokens of a batch are copied
+    // into one buffer of their own
+    std::vector<char> batch;
+    std::vector<size_t> starts(FREQ_BATCH_LINES);
+    std::vector<size_t> sizes(FREQ_BATCH_LINES);
+    std::vector<long long> counts(FREQ_BATCH_LINES);
+    std::vector<std::string> lemmas(FREQ_BATCH_LINES);
+    std::vector<size_t> partition_of(FREQ_BATCH_LINES);
+    long lines = 0;
+    long used = 0;
+    long skipped = 0;
+    std::atomic<long> invalid(0);
+
+    LineReader reader(fd);
+    bool eof = false;
+    while (!eof) {
+        batch.clear();
+        size_t n = 0;
+        char const* line;
+        size_t size;
+        while (n < FREQ_BATCH_LINES) {
+            if (!reader.next(line, size)) {
+                eof = true;
+                break;
+            }
+            ++lines;
+            size_t blank = 0;
+            while (blank < size && is_space(line[blank])) {
+                ++blank;
+            }
+            if (blank == size) {
+                continue;
+            }
+            char const* tab = static_cast<char const*>(
+                memrchr(line, '\t', size));
+            if (!tab || tab == line ||
+                !parse_count(tab + 1, line + size, counts[n]))
+            {
+                if (!opts.lenient) {
+                    if (fd != 0) {
+                        close(fd);
+                    }
+                    throw std::runtime_error("Malformed line "
+                                             + std::to_string(lines));
+                }
+                ++skipped;
+                continue;
+            }
+            starts[n] = batch.size();
+            sizes[n] = tab - line;
+            batch.insert(batch.end(), line, tab);
+            ++n;
+        }
+        used += n;
+
+        parallel_for(n, num_threads, [&](long begin, long end) {
+            std::string word;
+            long local_invalid = 0;
+            for (long i=begin ; i<end ; ++i) {
+                char const* token = batch.data() + starts[i];
+                if (opts.lowercase) {
+                    token::normalize(token, sizes[i], true, word);
+                } else {
+                    word.assign(token, sizes[i]);
+                }
+                if (model.lemmatize(word, lemmas[i]) == Model::INVALID) {
+                    ++local_invalid;
+                }
+                partition_of[i] = std::hash<std::string>()(lemmas[i])
+                                  % num_threads;
+            }
+            invalid += local_invalid;
+        });
+        if (invalid > 0 && !opts.lenient) {
+            if (fd != 0) {
+                close(fd);
+            }
+            throw std::runtime_error("Utf-8 decode error!");
+        }
+        parallel_for(num_threads, num_threads, [&](long begin, long end) {
+            for (long t=begin ; t<end ; ++t) {
+                Counts& partition = partitions[t];
+                for (size_t i=0 ; i<n ; ++i) {
+                    if (partition_of[i] == static_cast<size_t>(t)) {
+                        partition[lemmas[i]] += counts[i];
+                    }
+                }
+            }
+        });
+    }
+    if (fd != 0) {
+        close(fd);
+    }
+
+    // the partitions hold disjoint lemmas
+    std::vector<std::pair<long long, std::string const*>> table;
+    for (long t=0 ; t<num_threads ; ++t) {
+        for (auto i=partitions[t].begin() ; i!=partitions[t].end() ; ++i) {
+            table.push_back(std::make_pair(i->second, &i->first));
+        }
+    }
+    std::sort(table.begin(), table.end(),
+              [](std::pair<long long, std::string const*> const& a,
+                 std::pair<long long, std::string const*> const& b) {
+        return a.first != b.first ? a.first > b.first : *a.second < *b.second;
+    });
+    std::string out;
+    for (size_t i=0 ; i<table.size() ; ++i) {
+        out.clear();
+        out.append(*table[i].second);
+        out.push_back('\t');
+        append_number(table[i].first, out);
+        out.push_back('\n');
+        fwrite(out.data(), 1, out.size(), stdout);
+    }
+    fflush(stdout);
+    fprintf(stderr, "%ld lines, %ld lemmas", used,
+            static_cast<long>(table.size()));
+    if (opts.lenient) {
+        fprintf(stderr, ", %ld malformed lines skipped, %ld invalid words",
+                skipped, invalid.load());
+    }
+    fprintf(stderr, ".\n");
+}
+
+int freq_main(int argc, char** argv) {
+    FreqOptions opts;
+    std::vector<std::string> paths;
+    for (int i=2 ; i<argc ; ++i) {
         std::string s(argv[i]);
-        if (s == FLUSH_FLAG) {
-            flush_lines = true;
-        } else if (s == HELP_FLAG || s == HELP_FLAG2) {
-            print_usage();
-            exit(0);
-        } else if (s.substr(0, TRAIN_FLAG.size()) == TRAIN_FLAG) {
-            train_path = s.substr(TRAIN_FLAG.size());
-            train_mode = true;
-            fprintf(stderr, "train path: %s\n", train_path.c_str());
-        } else if (sscanf(argv[i], "--maxlen=%ld", &maxlen) == 1) {
-            fprintf(stderr, "Max suffix size will be %ld\n", maxlen);
-        } else if (i == 1) {
-            model_path = s;
+        if (sscanf(argv[i], "--threads=%ld", &opts.num_threads) == 1) {
+            continue;
+        } else if (s == "--lenient") {
+            opts.lenient = true;
+        } else if (s == "--lowercase") {
+            opts.lowercase = true;
+        } else if (s.size() > 0 && s[0] != '-' && paths.size() < 2) {
+            paths.push_back(s);
         } else {
             fprintf(stderr, ("Invalid argument: " + s + '\n').c_str());
             exit(-1);
         }
     }
-    if (model_path.size() == 0) {
+    if (paths.size() < 1) {
         fprintf(stderr, "model_path not given!\n");
         exit(-1);
     }
+    opts.model_path = paths[0];
+    if (paths.size() > 1) {
+        opts.input_path = paths[1];
+    }
+
+    try {
+        lemma_frequencies(opts);
+    } catch (std::exception& e) {
+        fprintf(stderr, "exception: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+struct FilesOptions {
+    std::string model_path;
+    std::string out_dir;
+    std::vector<std::string> inputs;  // files and directories
+    long num_threads;
+    bool lenient;
+    bool use_uring;
+
+    FilesOptions() : num_threads(std::thread::hardware_concurrency()),
+                     lenient(false), use_uring(true) {}
+};
+
+// a file lemmatized in files mode
+struct FileJob {
+    std::string input_path;
+    std::string output_path;
+    int fd;
+    std::vector<char> data;  // contents of the input file
+    std::string result;      // contents of the output file
+    size_t done;             // bytes read or written so far
+    std::string error;
+    long invalid;
+
+    FileJob() : fd(-1), done(0), invalid(0) {}
+};
+
+// list the input files, expanding directories to the regular files in them
+static void list_input_files(std::vector<std::string> const& inputs,
+                             std::vector<std::string>& files)
+{
+    for (size_t i=0 ; i<inputs.size() ; ++i) {
+        struct stat st;
+        if (stat(inputs[i].c_str(), &st) != 0) {
+            throw std::runtime_error("Could not stat " + inputs[i]);
+        }
+        if (!S_ISDIR(st.st_mode)) {
+            files.push_back(inputs[i]);
+            continue;
+        }
+        DIR* dir = opendir(inputs[i].c_str());
+        if (!dir) {
+            throw std::runtime_error("Could not open directory " + inputs[i]);
+        }
+        std::vector<std::string> names;
+        while (dirent* e = readdir(dir)) {
+            std::string path = inputs[i] + "/" + e->d_name;
+            if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+                names.push_back(path);
+            }
+        }
+        closedir(dir);
+        std::sort(names.begin(), names.end());
+        files.insert(files.end(), names.begin(), names.end());
+    }
+}
+
+// lemmatize the whitespace separated words of a file, one lemma per line
+static void lemmatize_file(Model const& model, bool lenient, FileJob& job) {
+    std::string word;
+    std::string lemma;
+    job.result.clear();
+    job.result.reserve(job.data.size() + job.data.size() / 4);
+    size_t i = 0;
+    size_t const size = job.data.size();
+    char const* data = job.data.data();
+    while (i < size) {
+        while (i < size && is_space(data[i])) {
+            ++i;
+        }
+        size_t end = i;
+        while (end < size && !is_space(data[end])) {
+            ++end;
+        }
+        if (end == i) {
+            break;
+        }
+        word.assign(data + i, end - i);
+        if (model.lemmatize(word, lemma) == Model::INVALID) {
+            if (!lenient) {
+                throw std::runtime_error("Utf-8 decode error!");
+            }
+            ++job.invalid;
+        }
+        job.result.append(lemma);
+        job.result.push_back('\n');
+        i = end;
+    }
+    // the input is not needed anymore
+    std::vector<char>().swap(job.data);
+}
+
+// files mode without io_uring: every worker reads, lemmatizes and writes
+// whole files with plain system calls
+static void process_files_sync(Model const& model, FilesOptions const& opts,
+                               std::vector<FileJob>& jobs)
+{
+    std::atomic<size_t> next(0);
+    parallel_for(opts.num_threads, opts.num_threads, [&](long, long) {
+        for (size_t j=next++ ; j<jobs.size() ; j=next++) {
+            FileJob& job = jobs[j];
+            try {
+                int fd = open(job.input_path.c_str(), O_RDONLY);
+                if (fd < 0) {
+                    throw std::runtime_error(
+                        std::string("Could not open file: ") + strerror(errno));
+                }
+                struct stat st;
+                fstat(fd, &st);
+                job.data.resize(st.st_size);
+                size_t done = 0;
+                while (done < job.data.size()) {
+                    ssize_t r = pread(fd, &job.data[done],
+                                      job.data.size() - done, done);
+                    if (r < 0 && errno == EINTR) {
+                        continue;
+                    } else if (r <= 0) {
+                        break;
+                    }
+                    done += r;
+                }
+                close(fd);
+                job.data.resize(done);
+                lemmatize_file(model, opts.lenient, job);
+                fd = open(job.output_path.c_str(),
+                          O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (fd < 0) {
+                    throw std::runtime_error("Could not create "
+                                             + job.output_path);
+                }
+                done = 0;
+                while (done < job.result.size()) {
+                    ssize_t w = pwrite(fd, job.result.data() + done,
+                                       job.result.size() - done, done);
+                    if (w < 0 && errno == EINTR) {
+                        continue;
+                    } else if (w < 0) {
+                        close(fd);
+                        throw std::runtime_error("Could not write "
+                                                 + job.output_path);
+                    }
+                    done += w;
+                }
+                close(fd);
+            } catch (std::exception& e) {
+                job.error = e.what();
+            }
+            std::string().swap(job.result);
+        }
+    });
+}
+
+// kinds of io_uring requests, stored in the low bits of their user data
+enum FileRequest { FILE_READ = 0, FILE_WRITE = 1, FILE_WAKEUP = 2 };
+
+// largest read or write in one request
+static const size_t MAX_FILE_REQUEST = 1 << 30;
+
+// files mode with io_uring: the calling thread reads and writes the files
+// through a single ring, keeping many files in flight, while workers
+// lemmatize the files that have been read. the workers wake the I/O thread
+// through an eventfd, whose read is one of the requests in the ring.
+// at most `depth` files are in flight, the ring needs one more entry.
+static void process_files_uring(Model const& model, FilesOptions const& opts,
+                                IoRing& ring, size_t depth,
+                                std::vector<FileJob>& jobs)
+{
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<size_t> to_lemmatize;
+    std::vector<size_t> to_write;
+    bool stopping = false;
+    int wakeup = eventfd(0, EFD_CLOEXEC);
+    if (wakeup < 0) {
+        throw std::runtime_error("Could not create eventfd.");
+    }
+
+    std::vector<std::thread> workers;
+    auto stop_workers = [&]() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            to_lemmatize.clear();
+        }
+        ready.notify_all();
+        for (size_t t=0 ; t<workers.size() ; ++t) {
+            workers[t].join();
+        }
+        close(wakeup);
+    };
+    for (long t=0 ; t<opts.num_threads ; ++t) {
+        workers.push_back(std::thread([&]() {
+            while (true) {
+                size_t j;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    while (to_lemmatize.empty() && !stopping) {
+                        ready.wait(lock);
+                    }
+                    if (to_lemmatize.empty()) {
+                        return;
+                    }
+                    j = to_lemmatize.front();
+                    to_lemmatize.pop_front();
+                }
+                try {
+                    lemmatize_file(model, opts.lenient, jobs[j]);
+                } catch (std::exception& e) {
+                    jobs[j].error = e.what();
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    to_write.push_back(j);
+                }
+                uint64_t one = 1;
+                if (::write(wakeup, &one, sizeof(one)) < 0) {
+                    perror("write");
+                }
+            }
+        }));
+    }
+
+    auto lemmatize_later = [&](size_t j) {
+        std::lock_guard<std::mutex> lock(mutex);
+        to_lemmatize.push_back(j);
+        ready.notify_one();
+    };
+    auto read_more = [&](size_t j) {
+        FileJob& job = jobs[j];
+        ring.read(job.fd, &job.data[job.done],
+                  std::min(job.data.size() - job.done, MAX_FILE_REQUEST),
+                  job.done, j << 2 | FILE_READ);
+    };
+    auto write_more = [&](size_t j) {
+        FileJob& job = jobs[j];
+        ring.write(job.fd, job.result.data() + job.done,
+                   std::min(job.result.size() - job.done, MAX_FILE_REQUEST),
+                   job.done, j << 2 | FILE_WRITE);
+    };
+    // a file is finished when written or failed
+    size_t in_flight = 0;
+    size_t finished = 0;
+    auto finish = [&](size_t j) {
+        FileJob& job = jobs[j];
+        if (job.fd >= 0) {
+            close(job.fd);
+            job.fd = -1;
+        }
+        std::string().swap(job.result);
+        std::vector<char>().swap(job.data);
+        --in_flight;
+        ++finished;
+    };
+
+    uint64_t wakeups;
+    ring.read(wakeup, &wakeups, sizeof(wakeups), 0, FILE_WAKEUP);
+    size_t next = 0;
+    std::vector<size_t> writes;
+    try {
+        while (finished < jobs.size()) {
+            // start reading files up to the queue depth
+            while (next < jobs.size() && in_flight < depth) {
+                size_t j = next++;
+                FileJob& job = jobs[j];
+                ++in_flight;
+                job.fd = open(job.input_path.c_str(), O_RDONLY);
+                struct stat st;
+                if (job.fd < 0 || fstat(job.fd, &st) != 0) {
+                    job.error = std::string("Could not open file: ")
+                                + strerror(errno);
+                    finish(j);
+                    continue;
+                }
+                job.data.resize(st.st_size);
+                job.done = 0;
+                if (job.data.empty()) {
+                    close(job.fd);
+                    job.fd = -1;
+                    lemmatize_later(j);
+                } else {
+                    read_more(j);
+                }
+            }
+            // start writing the lemmatized files
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                writes.swap(to_write);
+            }
+            for (size_t k=0 ; k<writes.size() ; ++k) {
+                size_t j = writes[k];
+                FileJob& job = jobs[j];
+                if (job.error.size() > 0) {
+                    finish(j);
+                    continue;
+                }
+                job.fd = open(job.output_path.c_str(),
+                              O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (job.fd < 0) {
+                    job.error = "Could not create " + job.output_path;
+                    finish(j);
+                } else if (job.result.empty()) {
+                    finish(j);
+                } else {
+                    job.done = 0;
+                    write_more(j);
+                }
+            }
+            writes.clear();
+            if (finished == jobs.size()) {
+                break;
+            }
+
+            ring.submit(1);
+            uint64_t user_data;
+            int result;
+            while (ring.complete(user_data, result)) {
+                size_t j = user_data >> 2;
+                FileJob& job = jobs[j];
+                switch (user_data & 3) {
+                    case FILE_WAKEUP:
+                        ring.read(wakeup, &wakeups, sizeof(wakeups), 0,
+                                  FILE_WAKEUP);
+                        break;
+                    case FILE_READ:
+                        if (result < 0) {
+                            job.error = std::string("Could not read file: ")
+                                        + strerror(-result);
+                            finish(j);
+                            break;
+                        }
+                        job.done += result;
+                        if (result > 0 && job.done < job.data.size()) {
+                            read_more(j);
+                            break;
+                        }
+                        // the file may have shrunk meanwhile
+                        job.data.resize(job.done);
+                        close(job.fd);
+                        job.fd = -1;
+                        lemmatize_later(j);
+                        break;
+                    case FILE_WRITE:
+                        if (result <= 0) {
+                            job.error = std::string("Could not write ")
+                                        + job.output_path + ": "
+                                        + strerror(result < 0 ? -result : EIO);
+                            finish(j);
+                            break;
+                        }
+                        job.done += result;
+                        if (job.done < job.result.size()) {
+                            write_more(j);
+                        } else {
+                            finish(j);
+                        }
+                        break;
+                }
+            }
+        }
+    } catch (...) {
+        stop_workers();
+        throw;
+    }
+    stop_workers();
+}
+
+// lemmatize many files, writing the lemmas of each into a file of the same
+// name in the output directory
+void lemmatize_files(FilesOptions const& opts) {
+    fprintf(stderr, "Loading model from %s.\n", opts.model_path.c_str());
+    Model model = Model::load(opts.model_path);
+    fprintf(stderr, "Loading model done!\n");
+
+    std::vector<std::string> files;
+    list_input_files(opts.inputs, files);
+    std::vector<FileJob> jobs(files.size());
+    std::set<std::string> names;
+    for (size_t j=0 ; j<files.size() ; ++j) {
+        size_t slash = files[j].rfind('/');
+        std::string name = slash == std::string::npos ?
+                           files[j] : files[j].substr(slash + 1);
+        if (!names.insert(name).second) {
+            throw std::runtime_error("Several input files are named " + name);
+        }
+        jobs[j].input_path = files[j];
+        jobs[j].output_path = opts.out_dir + "/" + name;
+    }
+
+    // the reads of this many files are kept in flight
+    size_t const depth = std::max(4L, 4 * opts.num_threads);
+    std::unique_ptr<IoRing> ring;
+    if (opts.use_uring) {
+        try {
+            ring.reset(new IoRing(depth + 1));
+        } catch (std::exception& e) {
+            fprintf(stderr, "%s, using pread.\n", e.what());
+        }
+    }
+    if (ring) {
+        process_files_uring(model, opts, *ring, depth, jobs);
+    } else {
+        process_files_sync(model, opts, jobs);
+    }
+
+    long failed = 0;
+    long invalid = 0;
+    for (size_t j=0 ; j<jobs.size() ; ++j) {
+        invalid += jobs[j].invalid;
+        if (jobs[j].error.size() > 0) {
+            fprintf(stderr, "%s: %s\n", jobs[j].input_path.c_str(),
+                    jobs[j].error.c_str());
+            ++failed;
+        }
+    }
+    fprintf(stderr, "%ld files lemmatized, %ld failed", jobs.size() - failed,
+            failed);
+    if (opts.lenient) {
+        fprintf(stderr, ", %ld invalid words", invalid);
+    }
+    fprintf(stderr, ".\n");
+    if (failed > 0) {
+        throw std::runtime_error("Some files could not be lemmatized.");
+    }
+}
+
+int files_main(int argc, char** argv) {
+    FilesOptions opts;
+    const std::string OUT_FLAG = "--out=";
+    for (int i=2 ; i<argc ; ++i) {
+        std::string s(argv[i]);
+        if (sscanf(argv[i], "--threads=%ld", &opts.num_threads) == 1) {
+            opts.num_threads = std::max(1L, opts.num_threads);
+        } else if (s.substr(0, OUT_FLAG.size()) == OUT_FLAG) {
+            opts.out_dir = s.substr(OUT_FLAG.size());
+        } else if (s == "--lenient") {
+            opts.lenient = true;
+        } else if (s == "--no-uring") {
+            opts.use_uring = false;
+        } else if (s.size() > 0 && s[0] != '-') {
+            if (opts.model_path.size() == 0) {
+                opts.model_path = s;
+            } else {
+                opts.inputs.push_back(s);
+            }
+        } else {
+            fprintf(stderr, ("Invalid argument: " + s + '\n').c_str());
+            exit(-1);
+        }
+    }
+    if (opts.model_path.size() == 0 || opts.out_dir.size() == 0 ||
+        opts.inputs.size() == 0)
+    {
+        fprintf(stderr, "usage: suflem files model_path --out=directory "
+                        "path...\n");
+        exit(-1);
+    }
+
+    try {
+        lemmatize_files(opts);
+    } catch (std::exception& e) {
+        fprintf(stderr, "exception: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+struct BenchOptions {
+    std::string model_path;
+    std::string input_path;  // synthetic words, if empty
+    long num_threads;
+    long num_words;          // length of the synthetic stream
+    unsigned long seed;
+
+    BenchOptions() : num_threads(std::thread::hardware_concurrency()),
+                     num_words(1000000), seed(1) {}
+};
+
+// resident memory of the process in bytes
+static size_t resident_memory() {
+    long pages = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%*s %ld", &pages) != 1) {
+            pages = 0;
+        }
+        fclose(f);
+    }
+    return pages * sysconf(_SC_PAGESIZE);
+}
+
+// peak resident memory of the process in bytes
+static size_t peak_resident_memory() {
+    long kb = 0;
+    FILE* f = fopen("/proc/self/status", "r");
+    if (f) {
+        char line[256];
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "VmHWM: %ld kB", &kb) == 1) {
+                break;
+            }
+        }
+        fclose(f);
+    }
+    return kb * 1024;
+}
+
+static inline double seconds_since(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - t).count();
+}
+
+// draw `n` words from the words known to the model, the frequency of the
+// k-th word being proportional to 1/k like in natural text
+static void zipf_words(Model const& model, long n, unsigned long seed,
+                       std::vector<std::string>& words)
+{
+    std::vector<std::string> vocabulary = model.inflected_suffixes();
+    if (vocabulary.empty()) {
+        throw std::runtime_error("The model has no words to draw from.");
+    }
+    for (size_t i=0 ; i<vocabulary.size() ; ++i) {
+        if (vocabulary[i].size() > 0 && vocabulary[i][0] == '$') {
+            vocabulary[i].erase(0, 1);
+        }
+    }
+    // the order of the hash tables is not stable, the ranks are
+    std::sort(vocabulary.begin(), vocabulary.end());
+    std::mt19937_64 random(seed);
+    std::shuffle(vocabulary.begin(), vocabulary.end(), random);
+
+    std::vector<double> cumulative(vocabulary.size());
+    double sum = 0;
+    for (size_t k=0 ; k<vocabulary.size() ; ++k) {
+        sum += 1.0 / (k + 1);
+        cumulative[k] = sum;
+    }
+    std::uniform_real_distribution<double> uniform(0, sum);
+    words.resize(n);
+    for (long i=0 ; i<n ; ++i) {
+        size_t k = std::lower_bound(cumulative.begin(), cumulative.end(),
+                                    uniform(random)) - cumulative.begin();
+        words[i] = vocabulary[std::min(k, vocabulary.size() - 1)];
+    }
+}
+
+// an event counted by the performance counters per item, - if the counter
+// is not available
+static std::string per_item(PerfCounters const& counters,
+                            PerfCounters::Event event, long items)
+{
+    long long const value = counters.value(event);
+    if (value < 0 || items <= 0) {
+        return "-";
+    }
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.2f",
+             static_cast<double>(value) / items);
+    return buffer;
+}
+
+static void report_counters_unavailable(PerfCounters const& counters) {
+    if (!counters.available()) {
+        fprintf(stderr, "Performance counters are not available (%s).\n",
+                counters.error().c_str());
+    }
+}
+
+// measure lemmatization throughput and latency of a model
+void benchmark(BenchOptions const& opts) {
+    typedef std::chrono::steady_clock Clock;
+    size_t const rss_before = resident_memory();
+    Clock::time_point start = Clock::now();
+    alloc::Phase const previous = alloc::set_phase(alloc::LOAD);
+    Model model = Model::load(opts.model_path);
+    alloc::set_phase(previous);
+    double const load_time = seconds_since(start);
+    size_t const rss_model = resident_memory() - rss_before;
+
+    std::vector<std::string> words;
+    if (opts.input_path.size() > 0) {
+        int fd = open(opts.input_path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open file " + opts.input_path);
+        }
+        TokenReader reader(fd);
+        char const* token;
+        size_t size;
+        while (reader.next(token, size)) {
+            words.push_back(std::string(token, size));
+        }
+        close(fd);
+    } else {
+        zipf_words(model, opts.num_words, opts.seed, words);
+    }
+    long const n = words.size();
+    if (n == 0) {
+        throw std::runtime_error("No words to lemmatize.");
+    }
+
+    // the first pass warms up the caches and sizes the lemma buffer
+    std::string lemma;
+    for (long i=0 ; i<n ; ++i) {
+        model.lemmatize(words[i], lemma);
+    }
+
+    PerfCounters counters;
+    report_counters_unavailable(counters);
+    long const allocs_before = alloc::count();
+    counters.start();
+    start = Clock::now();
+    {
+        alloc::PhaseScope phase(alloc::LEMMATIZE);
+        for (long i=0 ; i<n ; ++i) {
+            model.lemmatize(words[i], lemma);
+        }
+    }
+    double const single_time = seconds_since(start);
+    counters.stop();
+    long const allocs = alloc::count() - allocs_before;
+
+    // timing every word costs some, so latencies are measured separately
+    std::vector<uint32_t> latencies(n);
+    for (long i=0 ; i<n ; ++i) {
+        Clock::time_point t = Clock::now();
+        model.lemmatize(words[i], lemma);
+        latencies[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - t).count();
+    }
+    auto percentile = [&](double p) -> uint32_t {
+        size_t k = std::min<size_t>(n - 1, p * n);
+        std::nth_element(latencies.begin(), latencies.begin() + k,
+                         latencies.end());
+        return latencies[k];
+    };
+
+    long const num_threads = std::max(1L, opts.num_threads);
+    start = Clock::now();
+    parallel_for(n, num_threads, [&](long begin, long end) {
+        std::string lemma;
+        for (long i=begin ; i<end ; ++i) {
+            model.lemmatize(words[i], lemma);
+        }
+    });
+    double const multi_time = seconds_since(start);
+
+    printf("words\t%ld\n", n);
+    printf("model_load_ms\t%.1f\n", 1e3 * load_time);
+    printf("model_rss_mb\t%.1f\n", rss_model / 1048576.0);
+    printf("model_estimated_mb\t%.1f\n", model.memory_usage() / 1048576.0);
+    printf("words_per_sec\t%.0f\n", n / single_time);
+    printf("ns_per_word\t%.1f\n", 1e9 * single_time / n);
+    printf("allocs_per_word\t%.2f\n", static_cast<double>(allocs) / n);
+    if (alloc::accounting()) {
+        printf("alloc_bytes_per_word\t%.1f\n",
+               static_cast<double>(alloc::usage(alloc::LEMMATIZE).bytes) / n);
+        printf("load_allocs\t%ld\n", alloc::usage(alloc::LOAD).count);
+        printf("load_alloc_bytes\t%ld\n", alloc::usage(alloc::LOAD).bytes);
+    } else {
+        printf("alloc_bytes_per_word\t-\n");
+        printf("load_allocs\t-\n");
+        printf("load_alloc_bytes\t-\n");
+    }
+    for (int e=0 ; e<PerfCounters::NUM_EVENTS ; ++e) {
+        PerfCounters::Event event = static_cast<PerfCounters::Event>(e);
+        printf("%s_per_word\t%s\n", PerfCounters::name(event),
+               per_item(counters, event, n).c_str());
+    }
+    printf("p50_ns\t%u\n", percentile(0.5));
+    printf("p99_ns\t%u\n", percentile(0.99));
+    printf("p999_ns\t%u\n", percentile(0.999));
+    printf("threads\t%ld\n", num_threads);
+    printf("threads_words_per_sec\t%.0f\n", n / multi_time);
+    printf("peak_rss_mb\t%.1f\n", peak_resident_memory() / 1048576.0);
+    fflush(stdout);
+}
+
+int bench_main(int argc, char** argv) {
+    BenchOptions opts;
+    std::vector<std::string> paths;
+    for (int i=2 ; i<argc ; ++i) {
+        std::string s(argv[i]);
+        if (sscanf(argv[i], "--threads=%ld", &opts.num_threads) == 1) {
+            continue;
+        } else if (sscanf(argv[i], "--words=%ld", &opts.num_words) == 1) {
+            continue;
+        } else if (sscanf(argv[i], "--seed=%lu", &opts.seed) == 1) {
+            continue;
+        } else if (s.size() > 0 && s[0] != '-' && paths.size() < 2) {
+            paths.push_back(s);
+        } else {
+            fprintf(stderr, ("Invalid argument: " + s + '\n').c_str());
+            exit(-1);
+        }
+    }
+    if (paths.size() < 1) {
+        fprintf(stderr, "model_path not given!\n");
+        exit(-1);
+    }
+    opts.model_path = paths[0];
+    if (paths.size() > 1) {
+        opts.input_path = paths[1];
+    }
+
+    try {
+        benchmark(opts);
+    } catch (std::exception& e) {
+        fprintf(stderr, "exception: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int generate_main(int argc, char** argv) {
+    CorpusOptions opts;
+    long num_tokens = 1000000;
+    std::string what;
+    for (int i=2 ; i<argc ; ++i) {
+        std::string s(argv[i]);
+        if (sscanf(argv[i], "--vocabulary=%ld", &opts.vocabulary) == 1) {
+            continue;
+        } else if (sscanf(argv[i], "--paradigms=%ld", &opts.paradigms) == 1) {
+            continue;
+        } else if (sscanf(argv[i], "--forms=%ld", &opts.forms) == 1) {
+            continue;
+        } else if (sscanf(argv[i], "--tokens=%ld", &num_tokens) == 1) {
+            continue;
+        } else if (sscanf(argv[i], "--min-suffix=%ld",
+                          &opts.min_suffix) == 1) {
+            continue;
+        } else if (sscanf(argv[i], "--max-suffix=%ld",
+                          &opts.max_suffix) == 1) {
+            continue;
+        } else if (sscanf(argv[i], "--suffix-decay=%lf",
+                          &opts.suffix_decay) == 1) {
+            continue;
+        } else if (sscanf(argv[i], "--non-ascii=%lf", &opts.non_ascii) == 1) {
+            continue;
+        } else if (sscanf(argv[i], "--seed=%lu", &opts.seed) == 1) {
+            continue;
+        } else if ((s == "train" || s == "tokens") && what.size() == 0) {
+            what = s;
+        } else {
+            fprintf(stderr, ("Invalid argument: " + s + '\n').c_str());
+            exit(-1);
+        }
+    }
+    if (what.size() == 0) {
+        fprintf(stderr, "Specify train or tokens!\n");
+        exit(-1);
+    }
+
+    try {
+        CorpusGenerator generator(opts);
+        if (what == "train") {
+            long lines = generator.training(stdout);
+            fprintf(stderr, "Generated %ld training lines.\n", lines);
+        } else {
+            generator.tokens(stdout, num_tokens);
+        }
+        if (fflush(stdout) != 0) {
+            throw std::runtime_error("Could not write to standard output.");
+        }
+    } catch (std::exception& e) {
+        fprintf(stderr, "exception: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+struct TrainBenchOptions {
+    std::vector<long> sizes;    // vocabularies of the generated corpora
+    std::vector<long> maxlens;  // values of --maxlen to train with
+    std::string directory;      // where the corpora and models are written
+    CorpusOptions corpus;
+
+    TrainBenchOptions() : directory("/tmp") {}
+};
+
+// parse a comma separated list of numbers
+static std::vector<long> parse_numbers(std::string const& s) {
+    std::vector<long> values;
+    size_t begin = 0;
+    while (begin <= s.size()) {
+        size_t end = std::min(s.find(',', begin), s.size());
+        values.push_back(atol(s.substr(begin, end - begin).c_str()));
+        begin = end + 1;
+    }
+    return values;
+}
+
+// start measuring the peak resident memory again from the current one
+static bool reset_peak_resident_memory() {
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write(fd, "5", 1) == 1;
+    close(fd);
+    return ok;
+}
+
+static size_t file_size(std::string const& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+// train models of increasing size and maxlen and report how the time and
+// memory scale
+void benchmark_training(TrainBenchOptions const& opts) {
+    typedef std::chrono::steady_clock Clock;
+    std::string const prefix = opts.directory + "/suflem-bench-train-" +
+                               std::to_string(getpid());
+    std::string const corpus_path = prefix + ".tsv";
+    std::string const model_path = prefix + ".model";
+    bool peak_reset = true;
+
+    printf("lines\tmaxlen\ttrain_s\tlines_per_sec\tupdates_per_sec\t"
+           "peak_rss_mb\tmodel_mb\tlemma_suffixes\tinflected_suffixes\t"
+           "replacements\ttrimmed_model_mb\ttrimmed_lemma_suffixes\t"
+           "trimmed_inflected_suffixes\ttrimmed_replacements\ttrim_ms\t"
+           "save_ms\tfile_mb\tallocs_per_line\talloc_bytes_per_line");
+    for (int e=0 ; e<PerfCounters::NUM_EVENTS ; ++e) {
+        printf("\t%s_per_line",
+               PerfCounters::name(static_cast<PerfCounters::Event>(e)));
+    }
+    printf("\n");
+    fflush(stdout);
+    PerfCounters counters;
+    report_counters_unavailable(counters);
+    try {
+        for (size_t i=0 ; i<opts.sizes.size() ; ++i) {
+            CorpusOptions corpus = opts.corpus;
+            corpus.vocabulary = opts.sizes[i];
+            FILE* fout = fopen(corpus_path.c_str(), "w");
+            if (!fout) {
+                throw std::runtime_error("Could not open file " + corpus_path);
+            }
+            try {
+                CorpusGenerator(corpus).training(fout);
+            } catch (...) {
+                fclose(fout);
+                throw;
+            }
+            if (fclose(fout) != 0) {
+                throw std::runtime_error("Could not write file " + corpus_path);
+            }
+
+            for (size_t j=0 ; j<opts.maxlens.size() ; ++j) {
+                // memory freed by the previous model is given back first,
+                // so that each peak belongs to its own model
+                malloc_trim(0);
+                peak_reset = reset_peak_resident_memory() && peak_reset;
+
+                Model::TrainingStats stats;
+                alloc::Usage const allocs_before = alloc::usage(alloc::TRAIN);
+                counters.start();
+                Clock::time_point start = Clock::now();
+                alloc::Phase const previous = alloc::set_phase(alloc::TRAIN);
+                Model model = Model::train(corpus_path, opts.maxlens[j],
+                                           &stats);
+                alloc::set_phase(previous);
+                double const train_time = seconds_since(start);
+                counters.stop();
+                alloc::Usage allocs = alloc::usage(alloc::TRAIN);
+                allocs.count -= allocs_before.count;
+                allocs.bytes -= allocs_before.bytes;
+                size_t const peak = peak_resident_memory();
+                size_t const memory = model.memory_usage();
+                Model::TableSizes const before = model.table_sizes();
+
+                start = Clock::now();
+                model.trim();
+                double const trim_time = seconds_since(start);
+                size_t const trimmed_memory = model.memory_usage();
+                Model::TableSizes const after = model.table_sizes();
+
+                start = Clock::now();
+                Model::save(model, model_path);
+                double const save_time = seconds_since(start);
+
+                printf("%ld\t%ld\t%.2f\t%.0f\t%.0f\t%.1f\t%.1f\t%ld\t%ld\t%ld\t"
+                       "%.1f\t%ld\t%ld\t%ld\t%.1f\t%.1f\t%.1f",
+                       stats.lines, opts.maxlens[j], train_time,
+                       stats.lines / train_time, stats.updates / train_time,
+                       peak / 1048576.0, memory / 1048576.0,
+                       before.lemma_suffixes, before.inflected_suffixes,
+                       before.replacements, trimmed_memory / 1048576.0,
+                       after.lemma_suffixes, after.inflected_suffixes,
+                       after.replacements, 1e3 * trim_time, 1e3 * save_time,
+                       file_size(model_path) / 1048576.0);
+                if (alloc::accounting() && stats.lines > 0) {
+                    printf("\t%.2f\t%.1f",
+                           static_cast<double>(allocs.count) / stats.lines,
+                           static_cast<double>(allocs.bytes) / stats.lines);
+                } else {
+                    printf("\t-\t-");
+                }
+                for (int e=0 ; e<PerfCounters::NUM_EVENTS ; ++e) {
+                    printf("\t%s", per_item(counters,
+                        static_cast<PerfCounters::Event>(e),
+                        stats.lines).c_str());
+                }
+                printf("\n");
+                fflush(stdout);
+            }
+        }
+    } catch (...) {
+        unlink(corpus_path.c_str());
+        unlink(model_path.c_str());
+        throw;
+    }
+    unlink(corpus_path.c_str());
+    unlink(model_path.c_str());
+    if (!peak_reset) {
+        fprintf(stderr, "Could not reset the peak memory, peak_rss_mb is the "
+                        "peak of the whole run.\n");
+    }
+}
+
+int bench_train_main(int argc, char** argv) {
+    TrainBenchOptions opts;
+    opts.sizes = parse_numbers("1000,10000,100000");
+    opts.maxlens = parse_numbers("4,8,12");
+    const std::string SIZES_FLAG = "--sizes=";
+    const std::string MAXLENS_FLAG = "--maxlens=";
+    const std::string DIR_FLAG = "--dir=";
+    for (int i=2 ; i<argc ; ++i) {
+        std::string s(argv[i]);
+        if (s.substr(0, SIZES_FLAG.size()) == SIZES_FLAG) {
+            opts.sizes = parse_numbers(s.substr(SIZES_FLAG.size()));
+        } else if (s.substr(0, MAXLENS_FLAG.size()) == MAXLENS_FLAG) {
+            opts.maxlens = parse_numbers(s.substr(MAXLENS_FLAG.size()));
+        } else if (s.substr(0, DIR_FLAG.size()) == DIR_FLAG) {
+            opts.directory = s.substr(DIR_FLAG.size());
+        } else if (sscanf(argv[i], "--paradigms=%ld",
+                          &opts.corpus.paradigms) == 1) {
+            continue;
+        } else if (sscanf(argv[i], "--forms=%ld", &opts.corpus.forms) == 1) {
+            continue;
+        } else if (sscanf(argv[i], "--seed=%lu", &opts.corpus.seed) == 1) {
+            continue;
+        } else {
+            fprintf(stderr, ("Invalid argument: " + s + '\n').c_str());
+            exit(-1);
+        }
+    }
+    // fail before the first timed run rather than after it
+    struct stat st;
+    if (stat(opts.directory.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "Not a directory: %s\n", opts.directory.c_str());
+        exit(-1);
+    }
+
+    try {
+        benchmark_training(opts);
+    } catch (std::exception& e) {
+        fprintf(stderr, "exception: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// parse --socket and --port arguments shared by server and client modes
+static bool parse_address_flag(std::string const& s, std::string& socket_path,
+                               int& port)
+{
+    const std::string SOCKET_FLAG = "--socket=";
+    if (s.substr(0, SOCKET_FLAG.size()) == SOCKET_FLAG) {
+        socket_path = s.substr(SOCKET_FLAG.size());
+        return true;
+    }
+    return sscanf(s.c_str(), "--port=%d", &port) == 1;
+}
+
+static Server* running_server = 0;
+static ShmRing* running_ring = 0;
+
+static void stop_server(int) {
+    if (running_server) {
+        running_server->stop();
+    }
+    if (running_ring) {
+        running_ring->stop();
+    }
+}
+
+// handler factory for the length prefixed batch protocol
+static Server::HandlerFactory batch_protocol(SharedModel& model) {
+    return [&model]() -> Server::Handler {
+        std::vector<std::string> words;
+        std::vector<std::string> lemmas;
+        return [&model, words, lemmas](char const* in, size_t size,
+                                       std::string& out, bool&) mutable {
+            size_t consumed = 0;
+            while (size_t n = protocol::parse_frame(in + consumed,
+                                                    size - consumed, words))
+            {
+                consumed += n;
+                model.get()->lemmatize(words, lemmas);
+                protocol::append_frame(lemmas, out);
+            }
+            return consumed;
+        };
+    };
+}
+
+// collects the requests of all connections of a worker into micro-batches,
+// so that many small requests are lemmatized together. a batch is answered
+// when it reaches max_words words, or when its oldest request has waited
+// max_delay microseconds.
+class Coalescer {
+    SharedModel& _model;
+    size_t _max_words;
+    long _max_delay;
+    std::vector<std::string> _words;
+    std::vector<std::string> _lemmas;
+    // responders of the requests and the end of their words in _words
+    std::vector<std::pair<Server::Responder, size_t>> _requests;
+    std::chrono::steady_clock::time_point _oldest;
+    std::string _out;
+
+public:
+    Coalescer(SharedModel& model, size_t max_words, long max_delay) :
+        _model(model), _max_words(max_words), _max_delay(max_delay)
+    { }
+
+    void add(std::vector<std::string>& words,
+             Server::Responder const& responder)
+    {
+        if (_requests.size() == 0) {
+            _oldest = std::chrono::steady_clock::now();
+        }
+        responder.defer();
+        for (size_t i=0 ; i<words.size() ; ++i) {
+            _words.push_back(std::move(words[i]));
+        }
+        _requests.push_back(std::make_pair(responder, _words.size()));
+        if (_words.size() >= _max_words) {
+            flush();
+        }
+    }
+
+    long run() {
+        if (_requests.size() == 0) {
+            return -1;
+        }
+        long waited = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - _oldest).count();
+        if (waited < _max_delay) {
+            return _max_delay - waited;
+        }
+        flush();
+        return -1;
+    }
+
+    void flush() {
+        _model.get()->lemmatize(_words, _lemmas);
+        size_t begin = 0;
+        for (size_t i=0 ; i<_requests.size() ; ++i) {
+            size_t end = _requests[i].second;
+            _out.clear();
+            try {
+                protocol::append_frame(_lemmas.begin() + begin,
+                                       _lemmas.begin() + end, _out);
+                _requests[i].first.respond(_out);
+            } catch (std::runtime_error&) {
+                // the lemmas do not fit into a frame
+                _requests[i].first.fail();
+            }
+            begin = end;
+        }
+        _words.clear();
+        _requests.clear();
+    }
+};
+
+// worker factory for the length prefixed batch protocol with coalescing
+static Server::WorkerFactory coalescing_protocol(SharedModel& model,
+                                                 size_t max_words,
+                                                 long max_delay)
+{
+    return [&model, max_words, max_delay]() {
+        std::shared_ptr<Coalescer> coalescer =
+            std::make_shared<Coalescer>(model, max_words, max_delay);
+        Server::WorkerProtocol protocol;
+        protocol.connect = [coalescer](Server::Responder const& responder)
+            -> Server::Handler
+        {
+            std::vector<std::string> words;
+            return [coalescer, responder, words](char const* in, size_t size,
+                                                 std::string&,
+                                                 bool&) mutable {
+                size_t consumed = 0;
+                while (size_t n = protocol::parse_frame(in + consumed,
+                                                        size - consumed,
+                                                        words))
+                {
+                    consumed += n;
+                    coalescer->add(words, responder);
+                }
+                return consumed;
+            };
+        };
+        protocol.run = [coalescer]() {
+            return coalescer->run();
+        };
+        return protocol;
+    };
+}
+
+// handler factory for the HTTP protocol. either the default model or the
+// registry may be missing.
+static Server::HandlerFactory http_protocol(SharedModel* model,
+                                            ModelRegistry* registry,
+                                            FeedbackModel* feedback)
+{
+    const std::string LEMMATIZE_PATH = "/lemmatize/";
+    http::Application app = [=](http::Request const& request,
+                                http::Response& response) {
+        if (request.path == "/health") {
+            response.body = "ok\n";
+        } else if (request.path == "/reload") {
+            if (request.method != "POST") {
+                response.status = 405;
+                response.body = "Use POST for /reload\n";
+                return;
+            }
+            if (registry) {
+                registry->clear();
+            }
+            if (model && !model->reload_async()) {
+                response.status = 503;
+                response.body = "Reload already in progress\n";
+            } else {
+                response.body = "reloading\n";
+            }
+        } else if (request.path == "/feedback" && feedback) {
+            if (request.method == "POST") {
+                std::vector<FeedbackModel::Example> examples;
+                FeedbackModel::parse(request.body, examples);
+                feedback->add(examples);
+            }
+            response.body = "examples\t" + std::to_string(feedback->size()) +
+                            "\npending\t" +
+                            std::to_string(feedback->pending()) + '\n';
+        } else if (request.path == "/languages" && registry) {
+            std::vector<std::string> languages = registry->languages();
+            std::vector<std::string> loaded = registry->loaded_languages();
+            for (size_t i=0 ; i<languages.size() ; ++i) {
+                bool is_loaded = std::find(loaded.begin(), loaded.end(),
+                                           languages[i]) != loaded.end();
+                response.body += languages[i] +
+                                 (is_loaded ? "\tloaded\n" : "\n");
+            }
+        } else if ((request.path == "/lemmatize" && model) ||
+                   (request.path.compare(0, LEMMATIZE_PATH.size(),
+                                         LEMMATIZE_PATH) == 0 && registry))
+        {
+            if (request.method != "POST") {
+                response.status = 405;
+                response.body = "Use POST for " + request.path + '\n';
+                return;
+            }
+            SharedModel::Snapshot snapshot;
+            if (request.path == "/lemmatize") {
+                snapshot = model->get();
+            } else {
+                std::string language =
+                    request.path.substr(LEMMATIZE_PATH.size());
+                try {
+                    snapshot = registry->get(language);
+                } catch (std::exception& e) {
+                    response.status = 404;
+                    response.body = std::string(e.what()) + '\n';
+                    return;
+                }
+            }
+            std::vector<std::string> words;
+            std::vector<std::string> lemmas;
+            bool json = http::parse_words(request, words);
+            snapshot->lemmatize(words, lemmas);
+            http::format_words(lemmas, json, response);
+        } else {
+            response.status = 404;
+            response.body = "Unknown path " + request.path + '\n';
+        }
+    };
+    return [app]() {
+        return http::handler(app);
+    };
+}
+
+// options of the server mode
+struct ServeOptions {
+    std::string model_path;
+    std::string socket_path;
+    int port;
+    bool use_http;
+    long num_threads;
+    std::string shm_name;
+    long shm_slots;
+    long shm_slot_size;
+    std::string models_dir;
+    long memory_budget;
+    std::string bind_host;
+    std::string feedback_path;
+    long feedback_interval;
+    long coalesce_words;
+    long coalesce_delay;
+
+    ServeOptions() : port(0), use_http(false), num_threads(1),
+                     shm_slots(64), shm_slot_size(1 << 16),
+                     memory_budget(0), bind_host("127.0.0.1"),
+                     feedback_interval(10), coalesce_words(0),
+                     coalesce_delay(0) {}
+};
+
+void serve_model(ServeOptions const& opts) {
+    std::unique_ptr<SharedModel> model;
+    std::unique_ptr<ModelRegistry> registry;
+    if (opts.model_path.size() > 0) {
+        fprintf(stderr, "Loading model from %s.\n", opts.model_path.c_str());
+        model.reset(new SharedModel(opts.model_path));
+        fprintf(stderr, "Loading model done!\n");
+    }
+    if (opts.models_dir.size() > 0) {
+        registry.reset(new ModelRegistry(opts.memory_budget << 20));
+        long n = registry->add_directory(opts.models_dir);
+        fprintf(stderr, "Found %ld models in %s.\n", n,
+                opts.models_dir.c_str());
+    }
+    HangupReloader reloader([&model, &registry]() {
+        if (registry) {
+            registry->clear();
+        }
+        if (model) {
+            model->reload();
+        }
+    });
+    // created after the reloader, as the feedback publisher thread must
+    // inherit the blocked SIGHUP
+    std::unique_ptr<FeedbackModel> feedback;
+    if (opts.feedback_path.size() > 0) {
+        feedback.reset(new FeedbackModel(*model, opts.feedback_path,
+                                         opts.feedback_interval));
+    }
+
+    std::unique_ptr<Server> server;
+    std::unique_ptr<ShmRing> ring;
+    if (opts.socket_path.size() > 0 || opts.port > 0) {
+        if (opts.use_http) {
+            server.reset(new Server(http_protocol(model.get(), registry.get(),
+                                                  feedback.get())));
+        } else if (opts.coalesce_words > 0) {
+            server.reset(new Server(coalescing_protocol(
+                *model, opts.coalesce_words, opts.coalesce_delay)));
+        } else {
+            server.reset(new Server(batch_protocol(*model)));
+        }
+    }
+    if (opts.socket_path.size() > 0) {
+        server->listen_unix(opts.socket_path);
+        fprintf(stderr, "Listening on %s.\n", opts.socket_path.c_str());
+    }
+    if (opts.port > 0) {
+        server->listen_tcp(opts.port, opts.bind_host);
+        fprintf(stderr, "Listening on %s port %d.\n",
+                opts.bind_host.c_str(), opts.port);
+    }
+    if (opts.shm_name.size() > 0) {
+        ring.reset(new ShmRing(opts.shm_name, opts.shm_slots,
+                               opts.shm_slot_size));
+        fprintf(stderr, "Serving shared memory ring %s.\n",
+                opts.shm_name.c_str());
+    }
+    running_server = server.get();
+    running_ring = ring.get();
+    signal(SIGINT, stop_server);
+    signal(SIGTERM, stop_server);
+    signal(SIGPIPE, SIG_IGN);
+    // the shared memory ring gets a thread of its own next to the sockets
+    std::thread ring_thread;
+    if (ring) {
+        SharedModel& shared = *model;
+        auto serve_ring = [&shared, &ring]() {
+            ring->serve([&shared](std::vector<std::string> const& words,
+                                  std::vector<std::string>& lemmas) {
+                shared.get()->lemmatize(words, lemmas);
+            });
+        };
+        if (server) {
+            ring_thread = std::thread(serve_ring);
+        } else {
+            serve_ring();
+        }
+    }
+    if (server) {
+        server->run(opts.num_threads);
+        if (ring) {
+            ring->stop();
+            ring_thread.join();
+        }
+    }
+    running_server = 0;
+    running_ring = 0;
+    fprintf(stderr, "Server stopped.\n");
+}
+
+int serve_main(int argc, char** argv) {
+    ServeOptions opts;
+    const std::string SHM_FLAG = "--shm=";
+    const std::string MODELS_FLAG = "--models=";
+    const std::string BIND_FLAG = "--bind=";
+    const std::string FEEDBACK_FLAG = "--feedback=";
+    for (int i=2 ; i<argc ; ++i) {
+        std::string s(argv[i]);
+        if (parse_address_flag(s, opts.socket_path, opts.port)) {
+            continue;
+        } else if (s == "--http") {
+            opts.use_http = true;
+        } else if (sscanf(argv[i], "--threads=%ld", &opts.num_threads) == 1) {
+            opts.num_threads = std::max(1L, opts.num_threads);
+        } else if (s.substr(0, SHM_FLAG.size()) == SHM_FLAG) {
+            opts.shm_name = s.substr(SHM_FLAG.size());
+        } else if (s.substr(0, MODELS_FLAG.size()) == MODELS_FLAG) {
+            opts.models_dir = s.substr(MODELS_FLAG.size());
+        } else if (sscanf(argv[i], "--memory=%ld", &opts.memory_budget) == 1) {
+            continue;
+        } else if (s.substr(0, BIND_FLAG.size()) == BIND_FLAG) {
+            opts.bind_host = s.substr(BIND_FLAG.size());
+        } else if (sscanf(argv[i], "--shm-slots=%ld", &opts.shm_slots) == 1) {
+            continue;
+        } else if (sscanf(argv[i], "--shm-slot-size=%ld",
+                          &opts.shm_slot_size) == 1) {
+            continue;
+        } else if (s.substr(0, FEEDBACK_FLAG.size()) == FEEDBACK_FLAG) {
+            opts.feedback_path = s.substr(FEEDBACK_FLAG.size());
+        } else if (sscanf(argv[i], "--feedback-interval=%ld",
+                          &opts.feedback_interval) == 1) {
+            opts.feedback_interval = std::max(1L, opts.feedback_interval);
+        } else if (sscanf(argv[i], "--coalesce=%ld",
+                          &opts.coalesce_words) == 1) {
+            continue;
+        } else if (sscanf(argv[i], "--coalesce-delay=%ld",
+                          &opts.coalesce_delay) == 1) {
+            opts.coalesce_delay = std::max(0L, opts.coalesce_delay);
+        } else if (i == 2 && s[0] != '-') {
+            opts.model_path = s;
+        } else {
+            fprintf(stderr, ("Invalid argument: " + s + '\n').c_str());
+            exit(-1);
+        }
+    }
+    if (opts.models_dir.size() > 0 && !opts.use_http) {
+        fprintf(stderr, "--models is supported in --http mode only!\n");
+        exit(-1);
+    }
+    if (opts.feedback_path.size() > 0 &&
+        (!opts.use_http || opts.model_path.size() == 0))
+    {
+        fprintf(stderr, "--feedback requires --http and model_path!\n");
+        exit(-1);
+    }
+    if (opts.coalesce_words > 0 && opts.use_http) {
+        fprintf(stderr, "--coalesce is not supported in --http mode!\n");
+        exit(-1);
+    }
+    if (opts.model_path.size() == 0 && opts.models_dir.size() == 0) {
+        fprintf(stderr, "model_path not given!\n");
+        exit(-1);
+    }
+    if (opts.model_path.size() == 0 && opts.shm_name.size() > 0) {
+        fprintf(stderr, "--shm requires model_path!\n");
+        exit(-1);
+    }
+    if (opts.shm_slots < 1 || opts.shm_slots > (1L << 16) ||
+        opts.shm_slot_size < 8 || opts.shm_slot_size > (1L << 30))
+    {
+        fprintf(stderr, "--shm-slots must be within 1..65536 and "
+                        "--shm-slot-size within 8..1073741824!\n");
+        exit(-1);
+    }
+    if (opts.socket_path.size() == 0 && opts.port <= 0 &&
+        opts.shm_name.size() == 0) {
+        fprintf(stderr, "--socket, --port or --shm must be given!\n");
+        exit(-1);
+    }
+
+    try {
+        serve_model(opts);
+    } catch (std::exception& e) {
+        fprintf(stderr, "exception: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+void query_server(std::function<void (std::vector<std::string> const&,
+                                      std::vector<std::string>&)> lemmatize,
+                  long batch_size)
+{
+    std::vector<std::string> words;
+    std::vector<std::string> lemmas;
+    char buffer[1099];
+    std::string input;
+    bool more = true;
+    while (more) {
+        words.clear();
+        while (static_cast<long>(words.size()) < batch_size &&
+               (more = (scanf("%1024s", buffer) == 1)))
+        {
+            input = buffer;
+            words.push_back(trim(input));
+        }
+        if (words.size() == 0) {
+            break;
+        }
+        lemmatize(words, lemmas);
+        for (size_t i=0 ; i<lemmas.size() ; ++i) {
+            printf("%s\n", lemmas[i].c_str());
+        }
+    }
+    fflush(stdout);
+}
+
+int client_main(int argc, char** argv) {
+    std::string socket_path = "";
+    std::string shm_name = "";
+    std::string host = "localhost";
+    int port = 0;
+    long batch_size = 1000;
+    const std::string SHM_FLAG = "--shm=";
+    const std::string HOST_FLAG = "--host=";
+    for (int i=2 ; i<argc ; ++i) {
+        std::string s(argv[i]);
+        if (parse_address_flag(s, socket_path, port)) {
+            continue;
+        } else if (s.substr(0, HOST_FLAG.size()) == HOST_FLAG) {
+            host = s.substr(HOST_FLAG.size());
+        } else if (s.substr(0, SHM_FLAG.size()) == SHM_FLAG) {
+            shm_name = s.substr(SHM_FLAG.size());
+        } else if (sscanf(argv[i], "--batch=%ld", &batch_size) == 1) {
+            batch_size = std::max(1L, batch_size);
+        } else {
+            fprintf(stderr, ("Invalid argument: " + s + '\n').c_str());
+            exit(-1);
+        }
+    }
+    if (socket_path.size() == 0 && port <= 0 && shm_name.size() == 0) {
+        fprintf(stderr, "--socket, --port or --shm must be given!\n");
+        exit(-1);
+    }
+
+    try {
+        if (shm_name.size() > 0) {
+            ShmRing ring(shm_name);
+            query_server([&ring](std::vector<std::string> const& words,
+                                 std::vector<std::string>& lemmas) {
+                ring.lemmatize(words, lemmas);
+            }, batch_size);
+        } else {
+            std::unique_ptr<Client> client(socket_path.size() > 0 ?
+                                           new Client(socket_path) :
+                                           new Client(host, port));
+            query_server([&client](std::vector<std::string> const& words,
+                                   std::vector<std::string>& lemmas) {
+                client->lemmatize(words, lemmas);
+            }, batch_size);
+        }
+    } catch (std::exception& e) {
+        fprintf(stderr, "exception: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+void shard_model(std::string const& model_path, long num_shards,
+                 std::string const& out_prefix)
+{
+    fprintf(stderr, "Loading model from %s.\n", model_path.c_str());
+    Model model = Model::load(model_path);
+    for (long i=0 ; i<num_shards ; ++i) {
+        std::string path = out_prefix + "." + std::to_string(i);
+        fprintf(stderr, "Saving shard %ld to %s\n", i, path.c_str());
+        Model::save(model.shard(i, num_shards), path);
+    }
+    fprintf(stderr, "Done!\n");
+}
+
+int shard_main(int argc, char** argv) {
+    long num_shards = 0;
+    if (argc != 5 || sscanf(argv[3], "%ld", &num_shards) != 1 ||
+        num_shards < 1)
+    {
+        fprintf(stderr, "usage: suflem shard model_path num_shards "
+                        "out_prefix\n");
+        exit(-1);
+    }
+    try {
+        shard_model(argv[2], num_shards, argv[4]);
+    } catch (std::exception& e) {
+        fprintf(stderr, "exception: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// connect to a server given as unix socket path or as host:port
+static Client* connect_address(std::string const& address) {
+    size_t colon = address.rfind(':');
+    if (colon != std::string::npos && colon + 1 < address.size() &&
+        address.find_first_not_of("0123456789", colon + 1) == std::string::npos)
+    {
+        return new Client(address.substr(0, colon),
+                          atoi(address.c_str() + colon + 1));
+    }
+    return new Client(address);
+}
+
+// handler factory forwarding batches to the shard servers owning the words.
+// every connection to the router gets its own connections to the shards.
+static Server::HandlerFactory router_protocol(
+    std::vector<std::string> const& shards)
+{
+    typedef std::vector<std::unique_ptr<Client>> Clients;
+    return [&shards]() -> Server::Handler {
+        std::shared_ptr<Clients> clients = std::make_shared<Clients>();
+        std::vector<std::string> words;
+        std::vector<std::string> lemmas;
+        std::vector<std::vector<std::string>> parts(shards.size());
+        std::vector<std::vector<std::string>> results(shards.size());
+        std::vector<size_t> owners;
+        return [=, &shards](char const* in, size_t size, std::string& out,
+                            bool&) mutable {
+            const size_t n = shards.size();
+            if (clients->size() == 0) {
+                for (size_t s=0 ; s<n ; ++s) {
+                    clients->push_back(std::unique_ptr<Client>(
+                        connect_address(shards[s])));
+                }
+            }
+            size_t consumed = 0;
+            while (size_t len = protocol::parse_frame(in + consumed,
+                                                      size - consumed, words))
+            {
+                consumed += len;
+                owners.resize(words.size());
+                for (size_t s=0 ; s<n ; ++s) {
+                    parts[s].clear();
+                }
+                for (size_t i=0 ; i<words.size() ; ++i) {
+                    owners[i] = Model::shard_of(words[i], n);
+                    parts[owners[i]].push_back(words[i]);
+                }
+                // send all sub-batches before waiting, so that the shards
+                // work on them in parallel
+                for (size_t s=0 ; s<n ; ++s) {
+                    if (parts[s].size() > 0) {
+                        (*clients)[s]->send(parts[s]);
+                    }
+                }
+                for (size_t s=0 ; s<n ; ++s) {
+                    if (parts[s].size() > 0) {
+                        (*clients)[s]->receive(results[s]);
+                        if (results[s].size() != parts[s].size()) {
+                            throw std::runtime_error("Invalid shard response.");
+                        }
+                    }
+                }
+                // merge the results back into request order
+                std::vector<size_t> next(n, 0);
+                lemmas.resize(words.size());
+                for (size_t i=0 ; i<words.size() ; ++i) {
+                    lemmas[i].swap(results[owners[i]][next[owners[i]]++]);
+                }
+                protocol::append_frame(lemmas, out);
+            }
+            return consumed;
+        };
+    };
+}
+
+void route_requests(std::vector<std::string> const& shards,
+                    ServeOptions const& opts)
+{
+    Server server(router_protocol(shards));
+    if (opts.socket_path.size() > 0) {
+        server.listen_unix(opts.socket_path);
+        fprintf(stderr, "Listening on %s.\n", opts.socket_path.c_str());
+    }
+    if (opts.port > 0) {
+        server.listen_tcp(opts.port, opts.bind_host);
+        fprintf(stderr, "Listening on %s port %d.\n",
+                opts.bind_host.c_str(), opts.port);
+    }
+    fprintf(stderr, "Routing to %ld shards.\n",
+            static_cast<long>(shards.size()));
+    running_server = &server;
+    signal(SIGINT, stop_server);
+    signal(SIGTERM, stop_server);
+    signal(SIGPIPE, SIG_IGN);
+    server.run(opts.num_threads);
+    running_server = 0;
+    fprintf(stderr, "Router stopped.\n");
+}
+
+int route_main(int argc, char** argv) {
+    ServeOptions opts;
+    std::vector<std::string> shards;
+    const std::string SHARDS_FLAG = "--shards=";
+    const std::string BIND_FLAG = "--bind=";
+    for (int i=2 ; i<argc ; ++i) {
+        std::string s(argv[i]);
+        if (parse_address_flag(s, opts.socket_path, opts.port)) {
+            continue;
+        } else if (sscanf(argv[i], "--threads=%ld", &opts.num_threads) == 1) {
+            opts.num_threads = std::max(1L, opts.num_threads);
+        } else if (s.substr(0, BIND_FLAG.size()) == BIND_FLAG) {
+            opts.bind_host = s.substr(BIND_FLAG.size());
+        } else if (s.substr(0, SHARDS_FLAG.size()) == SHARDS_FLAG) {
+            std::string list = s.substr(SHARDS_FLAG.size()) + ',';
+            for (size_t b=0, e ; (e = list.find(',', b)) != std::string::npos ;
+                 b=e+1)
+            {
+                if (e > b) {
+                    shards.push_back(list.substr(b, e - b));
+                }
+            }
+        } else {
+            fprintf(stderr, ("Invalid argument: " + s + '\n').c_str());
+            exit(-1);
+        }
+    }
+    if (shards.size() == 0) {
+        fprintf(stderr, "--shards not given!\n");
+        exit(-1);
+    }
+    if (opts.socket_path.size() == 0 && opts.port <= 0) {
+        fprintf(stderr, "--socket or --port must be given!\n");
+        exit(-1);
+    }
+
+    try {
+        route_requests(shards, opts);
+    } catch (std::exception& e) {
+        fprintf(stderr, "exception: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+    LemmatizeOptions opts;
+    std::string train_path = "";
+    bool train_mode  = false;
+    long maxlen = 8;
+
+    const std::string TRAIN_FLAG = "--train=";
+    const std::string FLUSH_FLAG = "--flush";
+    const std::string LENIENT_FLAG = "--lenient";
+    const std::string LOWERCASE_FLAG = "--lowercase";
+    const std::string BYPASS_FLAG = "--bypass";
+    const std::string CACHE_FLAG = "--cache=";
+    const std::string JSONL_FLAG = "--jsonl=";
+    const std::string IDS_FLAG = "--ids=";
+    const std::string FRAMING_FLAG = "--framing=";
+    const std::string OFFSETS_FLAG = "--offsets";
+    const std::string STATS_FLAG = "--stats";
+    const std::string HELP_FLAG  = "-h";
+    const std::string HELP_FLAG2 = "--help";
+
+    if (argc > 1 && std::string(argv[1]) == "diff") {
+        return diff_main(argc, argv);
+    } else if (argc > 1 && std::string(argv[1]) == "serve") {
+        return serve_main(argc, argv);
+    } else if (argc > 1 && std::string(argv[1]) == "client") {
+        return client_main(argc, argv);
+    } else if (argc > 1 && std::string(argv[1]) == "bench") {
+        return bench_main(argc, argv);
+    } else if (argc > 1 && std::string(argv[1]) == "generate") {
+        return generate_main(argc, argv);
+    } else if (argc > 1 && std::string(argv[1]) == "bench-train") {
+        return bench_train_main(argc, argv);
+    } else if (argc > 1 && std::string(argv[1]) == "files") {
+        return files_main(argc, argv);
+    } else if (argc > 1 && std::string(argv[1]) == "freq") {
+        return freq_main(argc, argv);
+    } else if (argc > 1 && std::string(argv[1]) == "shard") {
+        return shard_main(argc, argv);
+    } else if (argc > 1 && std::string(argv[1]) == "route") {
+        return route_main(argc, argv);
+    }
+
+    // try to parse arguments
+    for (int i=1 ; i<argc ; ++i) {
+        std::string s(argv[i]);
+        if (s == FLUSH_FLAG) {
+            opts.flush_lines = true;
+        } else if (s == LENIENT_FLAG) {
+            opts.lenient = true;
+        } else if (s == LOWERCASE_FLAG) {
+            opts.lowercase = true;
+        } else if (s == BYPASS_FLAG) {
+            opts.bypass = true;
+        } else if (s == HELP_FLAG || s == HELP_FLAG2) {
+            print_usage();
+            exit(0);
+        } else if (s.substr(0, TRAIN_FLAG.size()) == TRAIN_FLAG) {
+            train_path = s.substr(TRAIN_FLAG.size());
+            train_mode = true;
+            fprintf(stderr, "train path: %s\n", train_path.c_str());
+        } else if (s.substr(0, CACHE_FLAG.size()) == CACHE_FLAG) {
+            opts.cache_path = s.substr(CACHE_FLAG.size());
+        } else if (s == OFFSETS_FLAG) {
+            opts.offsets = true;
+        } else if (s == STATS_FLAG) {
+            opts.stats = true;
+        } else if (s == FRAMING_FLAG + "binary") {
+            opts.binary = true;
+        } else if (s == FRAMING_FLAG + "text") {
+            opts.binary = false;
+        } else if (s.substr(0, IDS_FLAG.size()) == IDS_FLAG) {
+            opts.ids_path = s.substr(IDS_FLAG.size());
+        } else if (s.substr(0, JSONL_FLAG.size()) == JSONL_FLAG) {
+            opts.json_field = s.substr(JSONL_FLAG.size());
+        } else if (sscanf(argv[i], "--tsv=%ld", &opts.tsv_column) == 1) {
+            if (opts.tsv_column < 1) {
+                fprintf(stderr, "--tsv column must be at least 1\n");
+                exit(-1);
+            }
+        } else if (sscanf(argv[i], "--maxlen=%ld", &maxlen) == 1) {
+            fprintf(stderr, "Max suffix size will be %ld\n", maxlen);
+        } else if (i == 1) {
+            opts.model_path = s;
+        } else {
+            fprintf(stderr, ("Invalid argument: " + s + '\n').c_str());
+            exit(-1);
+        }
+    }
+    if (opts.model_path.size() == 0) {
+        fprintf(stderr, "model_path not given!\n");
+        exit(-1);
+    }
+    if (opts.tsv_column > 0 && opts.json_field.size() > 0) {
+        fprintf(stderr, "--tsv and --jsonl are mutually exclusive\n");
+        exit(-1);
+    }
+    if ((opts.tsv_column > 0 || opts.json_field.size() > 0) &&
+        (opts.ids_path.size() > 0 || opts.offsets))
+    {
+        fprintf(stderr, "--ids and --offsets can not be used with records\n");
+        exit(-1);
+    }
+    if (opts.binary && (opts.tsv_column > 0 || opts.json_field.size() > 0 ||
+                        opts.ids_path.size() > 0 || opts.offsets))
+    {
+        fprintf(stderr, "--framing=binary can not be used with --tsv, "
+                        "--jsonl, --ids or --offsets\n");
+        exit(-1);
+    }
 
     try {
         if (train_mode) {
-            train_model(model_path, train_path, maxlen);
+            train_model(opts.model_path, train_path, maxlen, opts.lenient,
+                        opts.stats);
         } else {
-            lemmatize_input(model_path, flush_lines);
+            lemmatize_input(opts);
         }
     } catch (std::exception& e) {
         fprintf(stderr, "exception: %s\n", e.what());
@@ -0,0 +1,212 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "suflem_c.h"
+#include "Model.hpp"
+#include "Dictionary.hpp"
+
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <exception>
+
+using namespace suflem;
+
+struct suflem_model {
+    Model model;
+
+    explicit suflem_model(Model&& m) : model(std::move(m)) {}
+};
+
+struct suflem_dictionary {
+    LemmaDictionary dictionary;
+    std::mutex mutex;
+};
+
+// error message and batch buffers of the calling thread
+static thread_local std::string last_error;
+static thread_local std::vector<std::string> batch_words;
+static thread_local std::vector<std::string> batch_lemmas;
+
+extern "C" {
+
+int suflem_api_version(void) {
+    return SUFLEM_API_VERSION;
+}
+
+const char* suflem_last_error(void) {
+    return last_error.c_str();
+}
+
+suflem_model* suflem_load(const char* path) {
+    try {
+        return new suflem_model(Model::load(path));
+    } catch (std::exception& e) {
+        last_error = e.what();
+    } catch (...) {
+        last_error = "Unknown error.";
+    }
+    return 0;
+}
+
+void suflem_free(suflem_model* model) {
+    delete model;
+}
+
+long suflem_lemmatize(const suflem_model* model, const char* word,
+                      char* out, size_t out_size)
+{
+    try {
+        std::string lemma;
+        if (model->model.lemmatize(word, lemma) == Model::INVALID) {
+            last_error = "Utf-8 decode error!";
+            return SUFLEM_ERROR;
+        }
+        if (lemma.size() >= out_size) {
+            last_error = "Output buffer too small.";
+            return SUFLEM_BUFFER_TOO_SMALL;
+        }
+        memcpy(out, lemma.c_str(), lemma.size() + 1);
+        return lemma.size();
+    } catch (std::exception& e) {
+        last_error = e.what();
+    } catch (...) {
+        last_error = "Unknown error.";
+    }
+    return SUFLEM_ERROR;
+}
+
+int suflem_lemmatize_batch(const suflem_model* model,
+                           const char* words, const size_t* offsets,
+                           size_t count,
+                           char* out, size_t out_size,
+                           size_t* out_offsets, size_t* out_used)
+{
+    try {
+        // the buffers keep their capacity between calls
+        batch_words.resize(count);
+        for (size_t i=0 ; i<count ; ++i) {
+            if (offsets[i+1] < offsets[i]) {
+                last_error = "Offsets are not ascending.";
+                return SUFLEM_ERROR;
+            }
+            batch_words[i].assign(words + offsets[i],
+                                  offsets[i+1] - offsets[i]);
+        }
+        model->model.lemmatize(batch_words, batch_lemmas);
+
+        size_t used = 0;
+        for (size_t i=0 ; i<count ; ++i) {
+            used += batch_lemmas[i].size();
+        }
+        *out_used = used;
+        if (used > out_size) {
+            last_error = "Output buffer too small.";
+            return SUFLEM_BUFFER_TOO_SMALL;
+        }
+        size_t pos = 0;
+        for (size_t i=0 ; i<count ; ++i) {
+            out_offsets[i] = pos;
+            memcpy(out + pos, batch_lemmas[i].data(), batch_lemmas[i].size());
+            pos += batch_lemmas[i].size();
+        }
+        out_offsets[count] = pos;
+        return SUFLEM_OK;
+    } catch (std::exception& e) {
+        last_error = e.what();
+    } catch (...) {
+        last_error = "Unknown error.";
+    }
+    return SUFLEM_ERROR;
+}
+
+suflem_dictionary* suflem_dictionary_load(const char* path) {
+    try {
+        suflem_dictionary* dictionary = new suflem_dictionary();
+        if (path) {
+            try {
+                dictionary->dictionary = LemmaDictionary(path);
+            } catch (...) {
+                delete dictionary;
+                throw;
+            }
+        }
+        return dictionary;
+    } catch (std::exception& e) {
+        last_error = e.what();
+    } catch (...) {
+        last_error = "Unknown error.";
+    }
+    return 0;
+}
+
+void suflem_dictionary_free(suflem_dictionary* dictionary) {
+    delete dictionary;
+}
+
+long suflem_dictionary_size(const suflem_dictionary* dictionary) {
+    std::lock_guard<std::mutex> lock(
+        const_cast<suflem_dictionary*>(dictionary)->mutex);
+    return dictionary->dictionary.size();
+}
+
+int suflem_dictionary_save(suflem_dictionary* dictionary, const char* path) {
+    try {
+        std::lock_guard<std::mutex> lock(dictionary->mutex);
+        dictionary->dictionary.save(path);
+        return SUFLEM_OK;
+    } catch (std::exception& e) {
+        last_error = e.what();
+    } catch (...) {
+        last_error = "Unknown error.";
+    }
+    return SUFLEM_ERROR;
+}
+
+int suflem_lemmatize_ids(const suflem_model* model,
+                         suflem_dictionary* dictionary,
+                         const char* words, const size_t* offsets,
+                         size_t count, long* ids)
+{
+    try {
+        batch_words.resize(count);
+        for (size_t i=0 ; i<count ; ++i) {
+            if (offsets[i+1] < offsets[i]) {
+                last_error = "Offsets are not ascending.";
+                return SUFLEM_ERROR;
+            }
+            batch_words[i].assign(words + offsets[i],
+                                  offsets[i+1] - offsets[i]);
+        }
+        // lemmatize outside of the lock, only the lookups are serialized
+        model->model.lemmatize(batch_words, batch_lemmas);
+        std::lock_guard<std::mutex> lock(dictionary->mutex);
+        for (size_t i=0 ; i<count ; ++i) {
+            ids[i] = dictionary->dictionary.id(batch_lemmas[i]);
+        }
+        return SUFLEM_OK;
+    } catch (std::exception& e) {
+        last_error = e.what();
+    } catch (...) {
+        last_error = "Unknown error.";
+    }
+    return SUFLEM_ERROR;
+}
+
+} // extern "C"
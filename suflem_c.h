@@ -0,0 +1,109 @@
+/* suffixlemmatizer - simple statistical suffix replacer for lemmatization.
+    Copyright (C) 2013  Timo Petmanson
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SUFLEM_C_H_INCLUDED
+#define SUFLEM_C_H_INCLUDED
+
+/* C interface of libsuflem for use from other languages.
+ * Models are opaque handles. No function throws, errors are reported by
+ * return values and described by suflem_last_error().
+ * A loaded model may be used by many threads at the same time. */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Version of this interface, incremented on incompatible changes. */
+#define SUFLEM_API_VERSION 1
+
+/* Return codes. */
+#define SUFLEM_OK 0
+#define SUFLEM_ERROR -1
+#define SUFLEM_BUFFER_TOO_SMALL -2
+
+typedef struct suflem_model suflem_model;
+typedef struct suflem_dictionary suflem_dictionary;
+
+/* Version of the library, compare it to SUFLEM_API_VERSION. */
+int suflem_api_version(void);
+
+/* Description of the last error in the calling thread. */
+const char* suflem_last_error(void);
+
+/* Load a trained model from file.
+ * Returns NULL on failure. */
+suflem_model* suflem_load(const char* path);
+
+/* Free a model. NULL is ignored. */
+void suflem_free(suflem_model* model);
+
+/* Lemmatize a single NUL terminated word.
+ * The lemma is written to `out` as NUL terminated string.
+ * Returns the length of the lemma, SUFLEM_ERROR if the word is not valid
+ * utf-8, or SUFLEM_BUFFER_TOO_SMALL if the lemma does not fit. */
+long suflem_lemmatize(const suflem_model* model, const char* word,
+                      char* out, size_t out_size);
+
+/* Lemmatize a batch of words with a single call.
+ * The words are packed into `words`, word i being the bytes from
+ * words[offsets[i]] to words[offsets[i+1]], so `offsets` has count+1
+ * entries. The lemmas are packed into `out` the same way, their offsets
+ * are written to `out_offsets`, which must have room for count+1 entries.
+ * Words that are not valid utf-8 are returned unchanged.
+ * `out_used` is set to the number of bytes the lemmas need. If they do not
+ * fit into `out_size` bytes, SUFLEM_BUFFER_TOO_SMALL is returned and the
+ * call can be repeated with a large enough buffer.
+ * Returns SUFLEM_OK on success. */
+int suflem_lemmatize_batch(const suflem_model* model,
+                           const char* words, const size_t* offsets,
+                           size_t count,
+                           char* out, size_t out_size,
+                           size_t* out_offsets, size_t* out_used);
+
+/* Load a lemma dictionary from file, or create an empty one if `path` is
+ * NULL. The dictionary assigns dense integer IDs to lemmas, see
+ * LemmaDictionary. It may be shared by many threads.
+ * Returns NULL on failure. */
+suflem_dictionary* suflem_dictionary_load(const char* path);
+
+/* Free a dictionary. NULL is ignored. */
+void suflem_dictionary_free(suflem_dictionary* dictionary);
+
+/* Number of lemmas in a dictionary. */
+long suflem_dictionary_size(const suflem_dictionary* dictionary);
+
+/* Write a dictionary to file, one lemma per line.
+ * Returns SUFLEM_OK on success. */
+int suflem_dictionary_save(suflem_dictionary* dictionary, const char* path);
+
+/* Lemmatize a batch of words into lemma IDs.
+ * The words are packed like in suflem_lemmatize_batch(). The ID of the
+ * lemma of word i is written to ids[i], new lemmas are added to the
+ * dictionary. Words that are not valid utf-8 are returned unchanged, that
+ * is, the ID of the word itself is written.
+ * Returns SUFLEM_OK on success. */
+int suflem_lemmatize_ids(const suflem_model* model,
+                         suflem_dictionary* dictionary,
+                         const char* words, const size_t* offsets,
+                         size_t count, long* ids);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SUFLEM_C_H_INCLUDED */